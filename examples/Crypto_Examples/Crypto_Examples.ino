@@ -73,8 +73,7 @@ AtEccX08 ecc = AtEccX08();
 // Specific key uses can be configured. Defaults here are for 16 ECC
 // keys that can be used to store provate keys for Sign/MAC use.
 // First 16 bytes are read only and are not included to save some space
-// TODO: Move to Flash
-static const uint8_t config_zone[]  =
+static const uint8_t config_zone[] PROGMEM =
 {
   /* 0-15 write only, not included, shown for reference
   0x01, 0x23, 0x00, 0x00, // 0-3 SN[0:3] RO
@@ -153,7 +152,7 @@ static const uint8_t config_zone[]  =
 // http://string-functions.com/hex-string.aspx
 // 64 bytes
 // CRYPTRONIX CRYPTOAUTH ARDUINO LIBRARY V: 0.2 ThingInnovations.
-static const uint8_t otp_zone[] =
+static const uint8_t otp_zone[] PROGMEM =
 {
   0x43, 0x52, 0x59, 0x50, 0x54, 0x52, 0x4f, 0x4e,
   0x49, 0x58, 0x20, 0x43, 0x52, 0x59, 0x50, 0x54,
@@ -516,8 +515,8 @@ void menuPersonalize() {
   if ( getConfirm() ) {
     Serial.println(F("Personalizing....."));
     // Call the personalize function
-    uint8_t respCode = ecc.personalize(  config_zone, sizeof( config_zone),
-                                         otp_zone, sizeof( otp_zone) );
+    uint8_t respCode = ecc.personalize_P(  config_zone, sizeof( config_zone),
+                                           otp_zone, sizeof( otp_zone) );
     if ( respCode != 0 ) {
       Serial.print(F("Fail personalize "));
       displayResponse(respCode, 0);
@@ -733,6 +732,8 @@ void setup() {
   // put your setup code here, to run once:
   Serial.begin(115200);
   ecc.enableDebug(&Serial);
+  // Keep up to 4 public keys in EEPROM from address 0
+  ecc.enableKeyCache(0, 4);
 
   displayMenu();
 }
@@ -0,0 +1,83 @@
+#include <cryptoauth.h>
+
+/* Times every SHA-256 backend on this board and prints the cost model
+   for Sha256Hash. The built-in costs are estimates; copy the setCost()
+   lines it prints into your sketch to use the measured ones instead,
+   and the setHashCost() lines for hash_verify() and verifyImage(). */
+
+AtEccX08 ecc = AtEccX08();
+Sha256Hash hasher = Sha256Hash(&ecc);
+
+static uint8_t message[503];
+
+static const char * const names[] = { "", "DEVICE", "SOFT", "ASM", "ATMEL" };
+
+// Costs are kept in 16 bits.
+uint16_t clampCost(unsigned long us) {
+    return us > 0xFFFF ? 0xFFFF : (uint16_t) us;
+}
+
+void printCost(const char *call, int b, uint16_t fixed, uint16_t block) {
+    Serial.print(call);
+    Serial.print("(SHA256_");
+    Serial.print(names[b]);
+    Serial.print(", ");
+    Serial.print(fixed);
+    Serial.print(", ");
+    Serial.print(block);
+    Serial.println(");");
+}
+
+unsigned long timeHash(Sha256Backend backend, int len) {
+    uint8_t digest[32];
+    unsigned long start = micros();
+
+    if (0 != hasher.hash(message, len, digest, backend))
+        return 0;
+
+    return micros() - start;
+}
+
+void setup() {
+    Serial.begin(9600);
+
+    for (unsigned int i = 0; i < sizeof(message); i++)
+        message[i] = i;
+
+    for (int b = SHA256_DEVICE; b <= SHA256_ATMEL; b++) {
+        Sha256Backend backend = (Sha256Backend) b;
+
+        if (!hasher.available(backend, 0)) {
+            Serial.print("// ");
+            Serial.print(names[b]);
+            Serial.println(" not available");
+            continue;
+        }
+
+        // 1 and 8 blocks once padded
+        unsigned long one = timeHash(backend, 0);
+        unsigned long eight = timeHash(backend, sizeof(message));
+
+        if (0 == one || eight < one) {
+            Serial.print("// ");
+            Serial.print(names[b]);
+            Serial.println(" failed");
+            continue;
+        }
+
+        uint16_t block = clampCost((eight - one) / 7);
+        uint16_t fixed = clampCost(one > block ? one - block : 0);
+
+        hasher.setCost(backend, fixed, block);
+        ecc.setHashCost(backend, fixed, block);
+
+        printCost("hasher.setCost", b, fixed, block);
+        printCost("ecc.setHashCost", b, fixed, block);
+    }
+
+    Serial.print("// Cheapest for 100 bytes: ");
+    Serial.println(names[hasher.choose(100)]);
+}
+
+void loop() {
+}
@@ -0,0 +1,59 @@
+#include <cryptoauth.h>
+
+/* Signs the same 16 digests one sign() at a time and then with one
+   signBatch(), and prints the throughput of both. Needs a personalized
+   device with a private key in slot 0. */
+
+#define RECORDS 16
+
+AtEccX08 ecc = AtEccX08();
+
+static uint8_t digests[RECORDS][32];
+static uint8_t signatures[RECORDS][64];
+static uint8_t status[RECORDS];
+
+void report(const char *label, unsigned long elapsed) {
+    Serial.print(label);
+    Serial.print(elapsed);
+    Serial.print(" us, ");
+    Serial.print(RECORDS * 1000000.0 / elapsed);
+    Serial.println(" signatures/s");
+}
+
+void setup() {
+    Serial.begin(9600);
+
+    for (int i = 0; i < RECORDS; i++)
+        memset(digests[i], i, sizeof(digests[i]));
+
+    unsigned long start = micros();
+    for (int i = 0; i < RECORDS; i++)
+        ecc.sign(0, digests[i], 32);
+    report("sign:      ", micros() - start);
+
+    start = micros();
+    uint8_t ret = ecc.signBatch(0, digests, RECORDS, signatures, status);
+    report("signBatch: ", micros() - start);
+
+    if (ret != 0) {
+        Serial.print("Failed! ");
+        Serial.println(ret, HEX);
+        return;
+    }
+
+    // One seed update for the whole batch
+    ecc.setSeedInterval(RECORDS);
+    start = micros();
+    ret = ecc.signBatch(0, digests, RECORDS, signatures, status);
+    report("signBatch, one seed update: ", micros() - start);
+
+    if (ret != 0) {
+        Serial.print("Failed! ");
+        Serial.println(ret, HEX);
+        for (int i = 0; i < RECORDS; i++)
+            Serial.println(status[i], HEX);
+    }
+}
+
+void loop() {
+}
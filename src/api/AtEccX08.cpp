@@ -18,10 +18,28 @@
  *
  */
 #include "AtEccX08.h"
+#include "EccSha256.h"
 #include "../ateccX08-atmel/eccX08_physical.h"
 #include "../ateccX08-atmel/eccX08_comm_marshaling.h"
 #include "../ateccX08-atmel/eccX08_lib_return_codes.h"
-#include "../softcrypto/sha256.h"
+
+extern "C" {
+#include "../atsha204-atmel/sha204_helper.h"
+#include "../atsha204-atmel/sha204_lib_return_codes.h"
+}
+
+// Configuration zone layout
+#define CONFIG_WRITABLE         16
+#define CONFIG_SLOT_CONFIG      20
+#define CONFIG_EXTRA            84
+#define CONFIG_LOCK_VALUE       86
+#define CONFIG_LOCK_CONFIG      87
+#define CONFIG_SLOT_LOCKED      88
+#define CONFIG_KEY_CONFIG       96
+
+// config_state flags
+#define CONFIG_CACHE_STATIC     0x01
+#define CONFIG_CACHE_LOCK_BYTES 0x02
 
 // Make these external to the library - need to be passed via personalisation sketch
 /*
@@ -54,19 +72,280 @@ static const uint8_t otp_zone[] =
   };
 */
 
+// Prebuilt packets of the constant commands, CRC included
+static constexpr EccFrame RANDOM_SEED_FRAME PROGMEM =
+  ecc_frame(ecc_random(RANDOM_SEED_UPDATE));
+static constexpr EccFrame RANDOM_NO_SEED_FRAME PROGMEM =
+  ecc_frame(ecc_random(RANDOM_NO_SEED_UPDATE));
+static constexpr EccFrame INFO_REVISION_FRAME PROGMEM =
+  ecc_frame(ecc_info(INFO_MODE_REVISION, 0x0000));
+static constexpr EccFrame READ_CONFIG_64_FRAME PROGMEM =
+  ecc_frame(ecc_read(ECCX08_ZONE_CONFIG | ECCX08_ZONE_COUNT_FLAG, 64 >> 2));
+static constexpr EccFrame COUNTER_FRAMES[2][2] PROGMEM =
+  {
+    { ecc_frame(ecc_counter(COUNTER_MODE_READ, 0)),
+      ecc_frame(ecc_counter(COUNTER_MODE_INC, 0)) },
+    { ecc_frame(ecc_counter(COUNTER_MODE_READ, 1)),
+      ecc_frame(ecc_counter(COUNTER_MODE_INC, 1)) }
+  };
+
+// Random (seed update) -> Nonce (pass-through) -> Sign (external)
+// inputs: 0 = 32 byte digest, args: 0 = key slot
+// Run from the second step when no seed update is due.
+static constexpr CommandStep SIGN_SCRIPT[] PROGMEM =
+  {
+    SCRIPT_STEP(ecc_random(RANDOM_SEED_UPDATE)),
+    SCRIPT_STEP_IN(ecc_nonce(NONCE_MODE_PASSTHROUGH,
+                             NONCE_NUMIN_SIZE_PASSTHROUGH),
+                   0, SCRIPT_INPUT(0), SCRIPT_NONE),
+    SCRIPT_STEP_IN(ecc_sign(SIGN_MODE_EXTERNAL, 0), SCRIPT_PARAM2_ARG,
+                   SCRIPT_NONE, SCRIPT_NONE)
+  };
+
+// Nonce (pass-through) -> Verify (external P256 key)
+// inputs: 0 = 32 byte digest, 1 = signature, 2 = public key
+static constexpr CommandStep VERIFY_SCRIPT[] PROGMEM =
+  {
+    SCRIPT_STEP_IN(ecc_nonce(NONCE_MODE_PASSTHROUGH,
+                             NONCE_NUMIN_SIZE_PASSTHROUGH),
+                   0, SCRIPT_INPUT(0), SCRIPT_NONE),
+    SCRIPT_STEP_IN(ecc_verify_external(VERIFY_256_SIGNATURE_SIZE,
+                                       VERIFY_256_KEY_SIZE),
+                   0, SCRIPT_INPUT(1), SCRIPT_INPUT(2))
+  };
+
+// Nonce (pass-through) -> Verify (stored P256 key)
+// inputs: 0 = 32 byte digest, 1 = signature, args: 0 = key slot
+static constexpr CommandStep VERIFY_STORED_SCRIPT[] PROGMEM =
+  {
+    SCRIPT_STEP_IN(ecc_nonce(NONCE_MODE_PASSTHROUGH,
+                             NONCE_NUMIN_SIZE_PASSTHROUGH),
+                   0, SCRIPT_INPUT(0), SCRIPT_NONE),
+    SCRIPT_STEP_IN(ecc_verify_stored(0, VERIFY_256_SIGNATURE_SIZE),
+                   SCRIPT_PARAM2_ARG, SCRIPT_INPUT(1), SCRIPT_NONE)
+  };
+
+static constexpr EccParams NONCE_RANDOM_NO_SEED =
+  ecc_nonce(NONCE_MODE_NO_SEED_UPDATE, NONCE_NUMIN_SIZE);
+static constexpr EccParams NONCE_PASSTHROUGH =
+  ecc_nonce(NONCE_MODE_PASSTHROUGH, NONCE_NUMIN_SIZE_PASSTHROUGH);
+
+static uint8_t *script_data(uint8_t ref, const uint8_t * const *inputs,
+                            uint8_t * const *outputs)
+{
+  if (SCRIPT_NONE == ref)
+    return NULL;
+
+  if (ref & SCRIPT_OUTPUT_FLAG)
+    return outputs ? outputs[ref & ~SCRIPT_OUTPUT_FLAG] : NULL;
+
+  return inputs ? const_cast<uint8_t *>(inputs[ref]) : NULL;
+}
+
+// Size of a zone, or of a slot in the data zone, in bytes.
+static uint16_t zone_size(uint8_t zone, uint8_t slot)
+{
+  switch (zone)
+    {
+    case ECCX08_ZONE_CONFIG:
+      return ECCX08_CONFIG_SIZE;
+    case ECCX08_ZONE_OTP:
+      return ECCX08_OTP_SIZE;
+    case ECCX08_ZONE_DATA:
+      if (slot > ECCX08_KEY_ID_MAX)
+        return 0;
+      if (slot < 8)
+        return 36;
+      return 8 == slot ? 416 : 72;
+    default:
+      return 0;
+    }
+}
+
+// Read/Write address of the word holding a byte offset. Data zone
+// addresses carry the slot in bits 3-6 and the block in bits 8-11, the
+// other zones the block in bits 3-4.
+static uint16_t zone_address(uint8_t zone, uint8_t slot, uint16_t offset)
+{
+  uint16_t block = offset / ECCX08_ZONE_ACCESS_32;
+  uint16_t word = (offset % ECCX08_ZONE_ACCESS_32) / ECCX08_ZONE_ACCESS_4;
+
+  if (ECCX08_ZONE_DATA == zone)
+    return (block << 8) | ((uint16_t) slot << 3) | word;
+
+  return (block << 3) | word;
+}
+
+// Worst case execution time of a command in ms.
+static uint16_t command_time(uint8_t op_code, uint8_t param1)
+{
+  uint8_t poll_delay, poll_timeout, response_size;
+
+  eccX08m_get_timing(op_code, param1, ECCX08_RSP_SIZE_MAX,
+                     &poll_delay, &poll_timeout, &response_size);
+
+  return poll_delay + poll_timeout;
+}
+
 AtEccX08::AtEccX08() : ADDRESS(0xC0)
 {
+    memset(&this->temp_key, 0, sizeof(this->temp_key));
     eccX08p_init();
 }
 
 
 
-AtEccX08::~AtEccX08() { }
+AtEccX08::~AtEccX08()
+{
+  memset(&this->temp_key, 0, sizeof(this->temp_key));
+}
 
 void AtEccX08::idle()
 {
-  if (this->always_idle)
-    eccX08p_idle();
+  if (this->always_idle && 0 == this->session_depth)
+    {
+      eccX08p_idle();
+      this->awake = false;
+    }
+}
+
+/** Keep track of the device state after a command. The marshaling layer
+ * puts the device to sleep when a command fails, so the next wakeup() of
+ * a session has to wake it again. The TempKey mirror only survives a
+ * successful Read, the command is still in the tx buffer.
+ *
+ * \param[in] ret_code status of the command
+ * \return ret_code
+ */
+uint8_t AtEccX08::commandDone(uint8_t ret_code)
+{
+  if (ECCX08_SUCCESS != ret_code)
+    this->awake = false;
+
+  if (ECCX08_SUCCESS != ret_code
+      || ECCX08_READ != this->command[ECCX08_OPCODE_IDX])
+    this->temp_key.valid = 0;
+
+  return ret_code;
+}
+
+/** Wake the device for a session, or join the one already running.
+ *
+ * \return status of the wake-up
+ */
+uint8_t AtEccX08::beginSession()
+{
+  this->session_depth++;
+
+  if (this->awake)
+    return ECCX08_SUCCESS;
+
+  return this->wakeDevice();
+}
+
+/** Leave a session. The outermost one idles the device, which keeps
+ * TempKey, or puts it to sleep.
+ *
+ * \param[in] sleep true to sleep instead of idle
+ */
+void AtEccX08::endSession(bool sleep)
+{
+  if (0 == this->session_depth || 0 != --this->session_depth)
+    return;
+
+  if (this->awake)
+    {
+      if (sleep)
+        eccX08p_sleep();
+      else
+        eccX08p_idle();
+    }
+
+  this->awake = false;
+}
+
+AtEccX08::Session::Session(AtEccX08 &device, bool sleep)
+  : device(device), sleep(sleep)
+{
+  this->wake_status = device.beginSession();
+}
+
+AtEccX08::Session::~Session()
+{
+  this->device.endSession(this->sleep);
+}
+
+uint8_t AtEccX08::Session::status() const
+{
+  return this->wake_status;
+}
+
+AtEccX08::ExecutionHook::ExecutionHook(AtEccX08 &device,
+                                       eccX08c_execution_hook_t hook,
+                                       void *context)
+  : device(device), previous(device.hook),
+    previous_context(device.hook_context)
+{
+  device.hook = hook;
+  device.hook_context = context;
+}
+
+AtEccX08::ExecutionHook::~ExecutionHook()
+{
+  this->device.hook = this->previous;
+  this->device.hook_context = this->previous_context;
+}
+
+/** Send a prebuilt command packet from flash, bypassing marshaling.
+ *
+ * \param[in] frame packet in PROGMEM, built with ecc_frame()
+ * \param[out] rx_buffer where the response goes, NULL for temp
+ * \param[in] rx_size size of rx_buffer
+ * \return status of the operation
+ */
+uint8_t AtEccX08::executeFrame(const EccFrame *frame, uint8_t *rx_buffer,
+                               uint8_t rx_size)
+{
+  memcpy_P(this->command, frame, sizeof(EccFrame));
+
+  if (NULL == rx_buffer)
+    {
+      rx_buffer = this->temp;
+      rx_size = sizeof(this->temp);
+    }
+
+  uint8_t ret_code = eccX08m_execute_frame(this->command, rx_size, rx_buffer);
+
+  return this->commandDone(ret_code);
+}
+
+/** Execute a command made by one of the checked builders in EccCommand.h.
+ * The hook armed with ExecutionHook, if any, runs while the device
+ * executes it.
+ *
+ * \param[in] cmd command parameters and data lengths
+ * \param[in] data1 first data block, cmd.data1_len bytes
+ * \param[in] data2 second data block, cmd.data2_len bytes
+ * \return ECCX08_BAD_PARAM if the builder rejected its arguments, otherwise
+ *         the status of the operation, response in temp
+ */
+uint8_t AtEccX08::execute(const EccParams &cmd, uint8_t *data1, uint8_t *data2)
+{
+  eccX08c_execution_hook_t hook = this->hook;
+
+  this->hook = NULL;
+
+  if (ECC_OP_INVALID == cmd.op_code)
+    return ECCX08_BAD_PARAM;
+
+  uint8_t ret_code = eccX08m_execute_hook(cmd.op_code, cmd.param1, cmd.param2,
+                                          cmd.data1_len, data1,
+                                          cmd.data2_len, data2, 0, NULL,
+                                          sizeof(this->command), this->command,
+                                          sizeof(this->temp), this->temp,
+                                          hook, this->hook_context);
+
+  return this->commandDone(ret_code);
 }
 
 uint8_t AtEccX08::wakeup()
@@ -74,10 +353,50 @@ uint8_t AtEccX08::wakeup()
   if (!this->always_wakeup)
     return 0;
 
+  return this->beginFlow(ECCX08_COMMAND_EXEC_MAX);
+}
+
+/** Make sure the device is awake long enough for a number of commands
+ * that must not be interrupted by the watchdog.
+ *
+ * Outside a session this is a plain wake-up. Within a session the device
+ * stays awake unless a failed command put it to sleep, and it is cycled
+ * through idle first if the flow would not finish before the watchdog.
+ *
+ * \param[in] worst_ms worst case execution time of the flow
+ * \return ECCX08_BAD_PARAM if the flow can't fit in a watchdog period,
+ *         otherwise the status of the wake-up
+ */
+uint8_t AtEccX08::beginFlow(uint16_t worst_ms)
+{
+  if (worst_ms > ECCX08_WATCHDOG_BUDGET_MS)
+    return ECCX08_BAD_PARAM;
+
+  if (!this->always_wakeup)
+    return 0;
+
+  if (0 == this->session_depth || !this->awake)
+    return this->wakeDevice();
+
+  if (millis() - this->wake_time + worst_ms <= ECCX08_WATCHDOG_BUDGET_MS)
+    return ECCX08_SUCCESS;
+
+  eccX08p_idle();
+  return this->wakeDevice();
+}
+
+uint8_t AtEccX08::wakeDevice()
+{
   uint8_t wakeup_response[ECCX08_RSP_SIZE_MIN];
 
   memset(wakeup_response, 0, sizeof(wakeup_response));
-  return eccX08c_wakeup(wakeup_response);
+  uint8_t ret_code = eccX08c_wakeup(wakeup_response);
+
+  // The device may have been asleep, which clears TempKey.
+  this->temp_key.valid = 0;
+  this->awake = (ECCX08_SUCCESS == ret_code);
+  this->wake_time = millis();
+  return ret_code;
 }
 
 const uint8_t AtEccX08::getAddress() const
@@ -87,35 +406,242 @@ const uint8_t AtEccX08::getAddress() const
 
 uint8_t AtEccX08::getRandom(bool update_seed)
 {
-    volatile uint8_t ret_code;
-
     uint8_t *random = &this->temp[ECCX08_BUFFER_POS_DATA];
 
-    //ret_code = ecc108m_random(this->command, this->temp,
-    //RANDOM_NO_SEED_UPDATE);
-    uint8_t SEED_UPDATE;
-
-    if (update_seed)
-      SEED_UPDATE = RANDOM_SEED_UPDATE;
-    else
-      SEED_UPDATE = RANDOM_NO_SEED_UPDATE;
-
     this->rsp.clear();
-    this->wakeup();
 
-    ret_code = eccX08m_execute(ECCX08_RANDOM, SEED_UPDATE, 0x0000,
-		    0, NULL, 0, NULL, 0, NULL,
-		    sizeof(this->command), this->command,
-		    sizeof(this->temp), this->temp);
+    uint8_t ret_code = this->randomCommand(update_seed);
 
     if (ret_code == ECCX08_SUCCESS)
-    {
         this->rsp.copyBufferFrom(random, 32);
+
+    return ret_code;
+}
+
+// Same without the copy to rsp, random points into the receive buffer.
+uint8_t AtEccX08::getRandom(RandomBlock &random, bool update_seed)
+{
+  uint8_t ret_code = this->randomCommand(update_seed);
+
+  random = RandomBlock(ECCX08_SUCCESS == ret_code
+                       ? &this->temp[ECCX08_BUFFER_POS_DATA] : NULL);
+  return ret_code;
+}
+
+// Random command, the 32 bytes are left in the receive buffer.
+uint8_t AtEccX08::randomCommand(bool update_seed)
+{
+  this->wakeup();
+
+  uint8_t ret_code = this->executeFrame(update_seed ? &RANDOM_SEED_FRAME
+                                        : &RANDOM_NO_SEED_FRAME);
+
+  if (ECCX08_SUCCESS == ret_code && update_seed)
+    this->signs_left = this->seed_interval;
+
+  this->idle();
+  return ret_code;
+}
+
+
+/** How often sign() updates the RNG seed. Every seed update is an EEPROM
+ * write, so signing many messages with an interval above 1 saves both a
+ * Random command per signature and wear. With 0 sign() never does it and
+ * the seed is only updated by refreshSeed(), e.g. from idle time.
+ *
+ * \param[in] signatures signatures per seed update, 0 for none
+ */
+void AtEccX08::setSeedInterval(uint16_t signatures)
+{
+  this->seed_interval = signatures;
+  if (this->signs_left > signatures)
+    this->signs_left = signatures;
+}
+
+/** Whether the next sign() will update the seed first. */
+bool AtEccX08::seedUpdateDue() const
+{
+  return 0 != this->seed_interval && 0 == this->signs_left;
+}
+
+/** Update the RNG seed now, which restarts the signature interval. */
+uint8_t AtEccX08::refreshSeed()
+{
+  return this->getRandom(true);
+}
+
+/** Keep random bytes in a pool, so randomBytes() can return small amounts
+ * without a Random command. Each Random gives 32 bytes; whatever a caller
+ * does not use is kept. No other call sends Random for the pool: when
+ * randomBytes() runs dry it tops the pool up with at most
+ * ECCX08_RANDOM_POOL_REFILL more commands, as long as the wake-up leaves
+ * time for them, and refillRandomPool() fills it completely, e.g. from
+ * idle time.
+ *
+ * The pool is not updated with a seed, and until the configuration zone is
+ * locked Random returns a fixed pattern, which the pool keeps like any
+ * other bytes.
+ *
+ * \param[in] buffer storage for the pool, NULL to disable it
+ * \param[in] size size of buffer, at least 32 to be topped up
+ */
+void AtEccX08::enableRandomPool(uint8_t *buffer, uint16_t size)
+{
+  if (NULL != this->pool)
+    memset(this->pool, 0, this->pool_size);
+
+  this->pool = buffer;
+  this->pool_size = NULL == buffer ? 0 : size;
+  this->pool_head = 0;
+  this->pool_count = 0;
+}
+
+/** Random bytes randomBytes() can return without a command. */
+uint16_t AtEccX08::randomAvailable() const
+{
+  return this->pool_count;
+}
+
+/** Fill dst with n random bytes, from the pool first and from as many
+ * Random commands as it takes for the rest. The unused end of the last
+ * command goes back to the pool, which is then topped up.
+ *
+ * \param[out] dst where the bytes go
+ * \param[in] n how many, any number
+ * \return status of the operation, dst is incomplete on failure
+ */
+uint8_t AtEccX08::randomBytes(uint8_t *dst, uint16_t n)
+{
+  if (NULL == dst && 0 != n)
+    return ECCX08_BAD_PARAM;
+
+  uint16_t taken = this->takeRandom(dst, n);
+
+  dst += taken;
+  n -= taken;
+  if (0 == n)
+    return ECCX08_SUCCESS;
+
+  uint8_t block[RANDOM_RSP_SIZE];
+  Session session(*this);
+  uint8_t ret_code = session.status();
+
+  while (ECCX08_SUCCESS == ret_code && 0 != n)
+    {
+      ret_code = this->randomBlock(block);
+      if (ECCX08_SUCCESS != ret_code)
+        break;
+
+      uint8_t chunk = n < 32 ? n : 32;
+
+      memcpy(dst, &block[ECCX08_BUFFER_POS_DATA], chunk);
+      dst += chunk;
+      n -= chunk;
+      if (0 == n)
+        this->putRandom(&block[ECCX08_BUFFER_POS_DATA + chunk], 32 - chunk);
+    }
+
+  memset(block, 0, sizeof(block));
+
+  if (ECCX08_SUCCESS == ret_code)
+    this->topUpRandomPool();
+
+  return ret_code;
+}
+
+/** Fill the random pool up to its size.
+ *
+ * \return status of the operation
+ */
+uint8_t AtEccX08::refillRandomPool()
+{
+  if (this->pool_size - this->pool_count < 32)
+    return ECCX08_SUCCESS;
+
+  uint8_t block[RANDOM_RSP_SIZE];
+  Session session(*this);
+  uint8_t ret_code = session.status();
+
+  while (ECCX08_SUCCESS == ret_code && this->pool_count < this->pool_size)
+    {
+      ret_code = this->randomBlock(block);
+      if (ECCX08_SUCCESS == ret_code)
+        this->putRandom(&block[ECCX08_BUFFER_POS_DATA], 32);
     }
 
+  memset(block, 0, sizeof(block));
+  return ret_code;
+}
+
+/** Run one Random without seed update into rx_buffer, leaving temp and
+ * with it rsp alone.
+ *
+ * \param[out] rx_buffer RANDOM_RSP_SIZE bytes
+ * \return status of the operation
+ */
+uint8_t AtEccX08::randomBlock(uint8_t *rx_buffer)
+{
+  uint8_t ret_code = this->beginFlow(RANDOM_EXEC_MAX);
 
-    this->idle();
+  if (ECCX08_SUCCESS != ret_code)
     return ret_code;
+
+  return this->executeFrame(&RANDOM_NO_SEED_FRAME, rx_buffer,
+                            RANDOM_RSP_SIZE);
+}
+
+/** Take up to n bytes from the random pool, clearing them there.
+ *
+ * \return how many bytes were taken
+ */
+uint16_t AtEccX08::takeRandom(uint8_t *dst, uint16_t n)
+{
+  uint16_t taken = 0;
+
+  while (taken < n && 0 != this->pool_count)
+    {
+      dst[taken++] = this->pool[this->pool_head];
+      this->pool[this->pool_head] = 0;
+      this->pool_head = (this->pool_head + 1) % this->pool_size;
+      this->pool_count--;
+    }
+
+  return taken;
+}
+
+// Add bytes to the random pool, dropping what does not fit.
+void AtEccX08::putRandom(const uint8_t *src, uint16_t n)
+{
+  while (0 != n-- && this->pool_count < this->pool_size)
+    {
+      this->pool[(this->pool_head + this->pool_count) % this->pool_size] =
+        *src++;
+      this->pool_count++;
+    }
+}
+
+/** Top up the random pool while the device is awake for randomBytes(),
+ * as long as the current wake-up leaves time for it.
+ */
+void AtEccX08::topUpRandomPool()
+{
+  uint8_t block[RANDOM_RSP_SIZE];
+
+  for (uint8_t i = 0; i < ECCX08_RANDOM_POOL_REFILL; i++)
+    {
+      if (!this->awake || this->pool_size - this->pool_count < 32
+          || millis() - this->wake_time + RANDOM_EXEC_MAX
+             > ECCX08_WATCHDOG_BUDGET_MS)
+        break;
+
+      if (ECCX08_SUCCESS != this->executeFrame(&RANDOM_NO_SEED_FRAME, block,
+                                               sizeof(block)))
+        break;
+
+      this->putRandom(&block[ECCX08_BUFFER_POS_DATA], 32);
+    }
+
+  memset(block, 0, sizeof(block));
 }
 
 
@@ -163,45 +689,75 @@ const uint8_t AtEccX08::write(uint8_t zone, uint16_t address, uint8_t *new_value
   //     p_command += WRITE_MAC_SIZE;
   //   }
 
-  return  eccX08m_execute(ECCX08_WRITE, param1, param2,
+  uint8_t ret_code = eccX08m_execute(ECCX08_WRITE, param1, param2,
 			  size, new_value, 0, NULL, 0, NULL,
 			  sizeof(this->command), this->command,
                		  sizeof(this->temp), this->temp);
 
+  if ((zone & ECCX08_ZONE_MASK) == ECCX08_ZONE_CONFIG)
+    this->invalidateConfig();
+
+  return this->commandDone(ret_code);
+
 }
 
 // Pass config
 // Skip first 16 bytes as not writeable
-void AtEccX08::burn_config(const uint8_t * data, uint8_t datalen )
-  {
- //   const uint8_t * data = default_config_zone;
+uint8_t AtEccX08::burn_config(const uint8_t * data, uint8_t datalen )
+{
+  Session session(*this);
 
-    this->rsp.clear();
+  uint8_t ret_code =
+    this->writeZone(ECCX08_ZONE_CONFIG, 0, CONFIG_WRITABLE,
+                    datalen < CONFIG_EXTRA - CONFIG_WRITABLE
+                    ? datalen : CONFIG_EXTRA - CONFIG_WRITABLE, data);
 
-    for (int x = 0; x < datalen; x+=ECCX08_ZONE_ACCESS_4)
-      {
-        this->wakeup();
-        this->write(ECCX08_ZONE_CONFIG, 16+x, const_cast<uint8_t *>(data+x), NULL,
-                    ECCX08_ZONE_ACCESS_4);
-        this->idle();
-      }
+  if (ECCX08_SUCCESS == ret_code && datalen > CONFIG_SLOT_LOCKED - CONFIG_WRITABLE)
+    ret_code = this->writeZone(ECCX08_ZONE_CONFIG, 0, CONFIG_SLOT_LOCKED,
+                               datalen - (CONFIG_SLOT_LOCKED - CONFIG_WRITABLE),
+                               data + (CONFIG_SLOT_LOCKED - CONFIG_WRITABLE));
 
-  }
+  return ret_code;
+}
 
-void AtEccX08::burn_otp(const uint8_t * data, uint8_t datalen)
+uint8_t AtEccX08::burn_otp(const uint8_t * data, uint8_t datalen)
 {
-//  const uint8_t * data = otp_zone;
+  return this->writeZone(ECCX08_ZONE_OTP, 0, 0, datalen, data);
+}
 
-  this->rsp.clear();
+/** CRC of the configuration zone as it will be after the image is
+ * written, for the Lock command. Bytes that provisioning does not write
+ * are taken from the configuration cache, which therefore has to be
+ * loaded.
+ *
+ * \param[in] image image of bytes 16 and up, a multiple of 4 bytes long
+ * \param[out] crc CRC over all 128 bytes
+ * \return ECCX08_SUCCESS, or the error of the image reader
+ */
+uint8_t AtEccX08::config_image_crc(const ImageSource &image, uint16_t &crc)
+{
+  uint8_t word[ECCX08_ZONE_ACCESS_4];
 
-  for (int x = 0; x < datalen; x+=ECCX08_ZONE_ACCESS_32)
+  crc = 0;
+  for (uint8_t x = 0; x < ECCX08_CONFIG_SIZE; x += ECCX08_ZONE_ACCESS_4)
     {
-      this->wakeup();
-      this->write(ECCX08_ZONE_OTP, x, const_cast<uint8_t *>(data+x), NULL,
-                  ECCX08_ZONE_ACCESS_32);
-      this->idle();
+      // Read-only bytes and bytes past the image come from the device.
+      const uint8_t *bytes = &this->config_cache[x];
+
+      if (x >= CONFIG_WRITABLE && x - CONFIG_WRITABLE < image.length()
+          && (x < CONFIG_EXTRA || x >= CONFIG_SLOT_LOCKED))
+        {
+          uint8_t ret_code = image.read(x - CONFIG_WRITABLE, word,
+                                        sizeof(word));
+          if (ECCX08_SUCCESS != ret_code)
+            return ret_code;
+          bytes = word;
+        }
+
+      crc = eccX08c_update_crc(crc, ECCX08_ZONE_ACCESS_4, bytes);
     }
 
+  return ECCX08_SUCCESS;
 }
 
 uint8_t AtEccX08::lock_config_zone()
@@ -223,11 +779,25 @@ uint8_t AtEccX08::lock_config_zone()
                         crc_array);
   crc = (crc_array[1] << 8) + crc_array[0];
 
+  return this->lock_config_zone(crc);
+}
+
+/** Lock the configuration zone, provided its contents match a CRC.
+ *
+ * \param[in] crc CRC over the 128 bytes of the zone
+ * \return status of the operation
+ */
+uint8_t AtEccX08::lock_config_zone(uint16_t crc)
+{
+  uint8_t ret_code;
+
   this->wakeup();
   ret_code = eccX08m_execute(ECCX08_LOCK, ECCX08_ZONE_CONFIG, crc,
                              0, NULL, 0, NULL, 0, NULL,
                              sizeof(this->command), this->command,
                              sizeof(this->temp), this->temp);
+  this->commandDone(ret_code);
+  this->invalidateConfig();
 
   this->idle();
 
@@ -247,6 +817,8 @@ uint8_t AtEccX08::lock_data_zone()
                              0, NULL, 0, NULL, 0, NULL,
                              sizeof(this->command), this->command,
                              sizeof(this->temp), this->temp);
+  this->commandDone(ret_code);
+  this->invalidateConfig();
 
   this->idle();
 
@@ -270,6 +842,8 @@ uint8_t AtEccX08::lockKeySlot( uint8_t slotNum )
                              0, NULL, 0, NULL, 0, NULL,
                              sizeof(this->command), this->command,
                              sizeof(this->temp), this->temp);
+  this->commandDone(ret_code);
+  this->invalidateConfig();
 
   this->idle();
 
@@ -277,277 +851,1028 @@ uint8_t AtEccX08::lockKeySlot( uint8_t slotNum )
 }
 
 
-// TODO: Use config from flash
+/** Write and lock the configuration zone, then the OTP zone, in a single
+ * session. Only the words that differ from the device are written, see
+ * provision().
+ */
 uint8_t AtEccX08::personalize(const uint8_t * config_zone_data, uint8_t configlen,const uint8_t * otp_zone_data, uint8_t otplen) 
 {
-  bool config_locked;
-  bool data_locked;
+  return this->provision(ImageSource(config_zone_data, configlen),
+                         ImageSource(otp_zone_data, otplen));
+}
 
-  config_locked = this->is_locked(0);
-  data_locked = this->is_locked(1);
+/** personalize() with both images in PROGMEM. They are read a block at a
+ * time and never copied to SRAM as a whole.
+ */
+uint8_t AtEccX08::personalize_P(const uint8_t * config_zone_data, uint8_t configlen,
+                                const uint8_t * otp_zone_data, uint8_t otplen)
+{
+  return this->provision(ImageSource::progmem(config_zone_data, configlen),
+                         ImageSource::progmem(otp_zone_data, otplen));
+}
 
-  if (!config_locked)
-    {
-      this->burn_config(config_zone_data,configlen);
-      this->lock_config_zone();
-    }
+/** Number of Writes burn_words() issues for a word mask. */
+static uint8_t count_writes(uint32_t words)
+{
+  uint8_t writes = 0;
 
-  if (!data_locked)
+  for (uint8_t word = 0; word < 32; word++)
     {
-      this->burn_otp(otp_zone_data,otplen);
-      this->lock_data_zone();
+      if (0 == word % 8 && 0xFF == ((words >> word) & 0xFF))
+        {
+          writes++;
+          word += 7;
+        }
+      else if (words & (1UL << word))
+        writes++;
     }
 
-  return 0;
+  return writes;
 }
 
-
-uint8_t AtEccX08::read_config_zone(uint8_t *config_data)
+uint8_t AtEccX08::provision(const uint8_t * config_zone_data, uint8_t configlen,
+                            const uint8_t * otp_zone_data, uint8_t otplen,
+                            ProvisionPlan *plan, bool dry_run)
 {
-  // declared as "volatile" for easier debugging
-  volatile uint8_t ret_code;
+  return this->provision(ImageSource(config_zone_data, configlen),
+                         ImageSource(otp_zone_data, otplen), plan, dry_run);
+}
 
-  uint16_t config_address;
+/** Bring the unlocked zones in line with an image and lock them. Both
+ * zones are read once and compared per word; only the words that differ
+ * are written. The configuration is not read back afterwards: the Lock
+ * command is given the CRC of the intended contents and fails if the
+ * Writes did not land. A device that refuses to read its OTP zone before
+ * the data zone is locked gets the whole OTP image. The images are read
+ * a block at a time, so they can stay in flash.
+ *
+ * \param[in] config image of the configuration zone from byte 16
+ * \param[in] otp image of the OTP zone
+ * \param[out] plan what is, or with dry_run would be, written and locked;
+ *             may be NULL
+ * \param[in] dry_run true to fill in the plan without writing or locking
+ * \return status of the first failing command or image read, or
+ *         ECCX08_SUCCESS. A zone is not locked after a failure.
+ */
+uint8_t AtEccX08::provision(const ImageSource &config, const ImageSource &otp,
+                            ProvisionPlan *plan, bool dry_run)
+{
+  ProvisionPlan local;
 
-  // Make the command buffer the size of the Read command.
-  uint8_t command[READ_COUNT];
+  if (config.length() > ECCX08_CONFIG_SIZE - CONFIG_WRITABLE
+      || otp.length() > ECCX08_OTP_SIZE
+      || config.length() % ECCX08_ZONE_ACCESS_4
+      || otp.length() % ECCX08_ZONE_ACCESS_4)
+    return ECCX08_BAD_PARAM;
 
-  // Make the response buffer the size of the maximum Read response.
-  uint8_t response[READ_32_RSP_SIZE];
+  if (!plan)
+    plan = &local;
+  memset(plan, 0, sizeof(*plan));
 
-  // Read first 32 bytes. Put a breakpoint after the read and inspect "response" to obtain the data.
-  ret_code = eccX08c_wakeup(response);
-  if (ret_code != ECCX08_SUCCESS)
-    return ret_code;
+  Session session(*this);
+  if (ECCX08_SUCCESS != session.status())
+    return session.status();
 
-  memset(response, 0, sizeof(response));
-  config_address = 0;
-  ret_code = eccX08m_execute(ECCX08_READ,
-                             ECCX08_ZONE_CONFIG | ECCX08_ZONE_COUNT_FLAG,
-                             config_address >> 2,
-                             0, NULL, 0, NULL, 0, NULL, sizeof(command),
-                             command, sizeof(response), response);
-  eccX08p_sleep();
-  if (ret_code != ECCX08_SUCCESS)
+  uint8_t ret_code = this->loadConfig(true);
+  if (ECCX08_SUCCESS != ret_code)
     return ret_code;
 
-  if (config_data) {
-    memcpy(config_data, &response[ECCX08_BUFFER_POS_DATA],
-           ECCX08_ZONE_ACCESS_32);
-    config_data += ECCX08_ZONE_ACCESS_32;
-  }
+  plan->lock_config = !this->is_locked(ECCX08_ZONE_CONFIG);
+  plan->lock_data = !this->is_locked(ECCX08_ZONE_DATA);
 
-  // Read second 32 bytes.
-  memset(response, 0, sizeof(response));
-  ret_code = eccX08c_wakeup(response);
-  if (ret_code != ECCX08_SUCCESS)
-    return ret_code;
+  // Every byte of both images is read here, before anything is written,
+  // so a reader that fails leaves the device untouched.
+  uint16_t crc = 0;
 
-  config_address += ECCX08_ZONE_ACCESS_32;
-  memset(response, 0, sizeof(response));
-  ret_code = eccX08m_execute(ECCX08_READ,
-                             ECCX08_ZONE_CONFIG | ECCX08_ZONE_COUNT_FLAG,
-                             config_address >> 2,
-                             0, NULL, 0, NULL, 0, NULL, sizeof(command),
-                             command, sizeof(response), response);
-  eccX08p_sleep();
-  if (ret_code != ECCX08_SUCCESS)
-    return ret_code;
+  if (plan->lock_config)
+    {
+      ret_code = this->diff_words(ECCX08_ZONE_CONFIG, config,
+                                  CONFIG_WRITABLE, plan->config_words);
+      if (ECCX08_SUCCESS == ret_code)
+        ret_code = this->config_image_crc(config, crc);
+    }
 
-  if (config_data) {
-    memcpy(config_data, &response[ECCX08_BUFFER_POS_DATA], ECCX08_ZONE_ACCESS_32);
-    config_data += ECCX08_ZONE_ACCESS_32;
-  }
+  if (ECCX08_SUCCESS == ret_code && plan->lock_data)
+    {
+      uint32_t words;
 
-  // Read third 32 bytes.
-  memset(response, 0, sizeof(response));
-  ret_code = eccX08c_wakeup(response);
-  if (ret_code != ECCX08_SUCCESS)
-    return ret_code;
+      ret_code = this->diff_words(ECCX08_ZONE_OTP, otp, 0, words);
+      plan->otp_words = words;
+    }
 
-  config_address += ECCX08_ZONE_ACCESS_32;
-  memset(response, 0, sizeof(response));
-  ret_code = eccX08m_execute(ECCX08_READ,
-                             ECCX08_ZONE_CONFIG | ECCX08_ZONE_COUNT_FLAG,
-                             config_address >> 2,
-                             0, NULL, 0, NULL, 0, NULL, sizeof(command),
-                             command, sizeof(response), response);
-  eccX08p_sleep();
-  if (ret_code != ECCX08_SUCCESS)
+  if (ECCX08_SUCCESS != ret_code)
     return ret_code;
 
-  if (config_data) {
-    memcpy(config_data, &response[ECCX08_BUFFER_POS_DATA], ECCX08_ZONE_ACCESS_32);
-    config_data += ECCX08_ZONE_ACCESS_32;
-  }
+  plan->writes = count_writes(plan->config_words)
+    + count_writes(plan->otp_words);
 
-  // Read foruth 32 bytes.
+  if (dry_run)
+    return ECCX08_SUCCESS;
 
-  memset(response, 0, sizeof(response));
-  ret_code = eccX08c_wakeup(response);
-  if (ret_code != ECCX08_SUCCESS)
-    return ret_code;
+  if (plan->lock_config)
+    {
+      ret_code = this->burn_words(ECCX08_ZONE_CONFIG, plan->config_words,
+                                  config, CONFIG_WRITABLE);
+      if (ECCX08_SUCCESS == ret_code)
+        ret_code = this->lock_config_zone(crc);
+      if (ECCX08_SUCCESS != ret_code)
+        return ret_code;
+    }
 
-  config_address += ECCX08_ZONE_ACCESS_32;
-  memset(response, 0, sizeof(response));
-  ret_code = eccX08m_execute(ECCX08_READ,
-                             ECCX08_ZONE_CONFIG | ECCX08_ZONE_COUNT_FLAG,
-                             config_address >> 2,
-                             0, NULL, 0, NULL, 0, NULL, sizeof(command),
-                             command, sizeof(response), response);
-  eccX08p_sleep();
-  if (ret_code != ECCX08_SUCCESS)
+  if (plan->lock_data)
+    {
+      ret_code = this->burn_words(ECCX08_ZONE_OTP, plan->otp_words,
+                                  otp, 0);
+      if (ECCX08_SUCCESS == ret_code)
+        ret_code = this->lock_data_zone();
+    }
+
+  return ret_code;
+}
+
+/** Mask of the words of a zone that differ from an image. The config
+ * zone is compared with the cache, the OTP zone is read a block at a time.
+ * Bytes 84-87 of the config zone are never included.
+ *
+ * \param[in] zone ECCX08_ZONE_CONFIG or ECCX08_ZONE_OTP
+ * \param[in] image image to compare with
+ * \param[in] image_offset zone byte that the image starts at
+ * \param[out] words bit n set if bytes 4n to 4n+3 differ
+ * \return ECCX08_SUCCESS, or the error of the image reader
+ */
+uint8_t AtEccX08::diff_words(uint8_t zone, const ImageSource &image,
+                             uint8_t image_offset, uint32_t &words)
+{
+  uint8_t current[ECCX08_ZONE_ACCESS_32];
+  uint8_t target[ECCX08_ZONE_ACCESS_4];
+  bool readable = true;
+
+  words = 0;
+
+  for (uint8_t x = image_offset; x < image_offset + image.length();
+       x += ECCX08_ZONE_ACCESS_4)
+    {
+      const uint8_t *device = &this->config_cache[x];
+
+      if (ECCX08_ZONE_CONFIG == zone)
+        {
+          if (x >= CONFIG_EXTRA && x < CONFIG_SLOT_LOCKED)
+            continue;
+        }
+      else
+        {
+          if (readable && (x == image_offset || 0 == x % ECCX08_ZONE_ACCESS_32))
+            readable = ECCX08_SUCCESS
+              == this->readZone(zone, 0, x - x % ECCX08_ZONE_ACCESS_32,
+                                ECCX08_ZONE_ACCESS_32, current);
+          device = &current[x % ECCX08_ZONE_ACCESS_32];
+        }
+
+      uint8_t ret_code = image.read(x - image_offset, target, sizeof(target));
+      if (ECCX08_SUCCESS != ret_code)
+        return ret_code;
+
+      if (!readable || memcmp(device, target, sizeof(target)))
+        words |= 1UL << (x / ECCX08_ZONE_ACCESS_4);
+    }
+
+  return ECCX08_SUCCESS;
+}
+
+/** Write the words of a zone set in a mask, a block at a time where all
+ * of its words are set. Each Write is sent from a block fetched from the
+ * image just before.
+ *
+ * \param[in] zone ECCX08_ZONE_CONFIG or ECCX08_ZONE_OTP
+ * \param[in] words bit n set to write bytes 4n to 4n+3
+ * \param[in] image source of the bytes written
+ * \param[in] image_offset zone byte that the image starts at
+ * \return status of the first failing read or Write, or ECCX08_SUCCESS
+ */
+uint8_t AtEccX08::burn_words(uint8_t zone, uint32_t words,
+                             const ImageSource &image, uint8_t image_offset)
+{
+  uint8_t ret_code = ECCX08_SUCCESS;
+  uint8_t block[ECCX08_ZONE_ACCESS_32];
+
+  Session session(*this);
+
+  for (uint8_t word = 0; word < 32 && ECCX08_SUCCESS == ret_code; word++)
+    {
+      uint8_t x = word * ECCX08_ZONE_ACCESS_4;
+      uint8_t n = 0;
+
+      if (0 == word % 8 && 0xFF == ((words >> word) & 0xFF))
+        {
+          n = ECCX08_ZONE_ACCESS_32;
+          word += 7;
+        }
+      else if (words & (1UL << word))
+        n = ECCX08_ZONE_ACCESS_4;
+
+      if (n)
+        {
+          ret_code = image.read(x - image_offset, block, n);
+          if (ECCX08_SUCCESS == ret_code)
+            ret_code = this->writeZone(zone, 0, x, n, block);
+        }
+    }
+
+  return ret_code;
+}
+
+
+uint8_t AtEccX08::read_config_zone(uint8_t *config_data)
+{
+  return this->readZone(ECCX08_ZONE_CONFIG, 0, 0, ECCX08_CONFIG_SIZE,
+                        config_data);
+}
+
+/** Read any number of bytes from a zone, or from a slot of the data zone,
+ * in one session. Whole blocks are read with 32 byte Reads, the rest with
+ * 4 byte Reads.
+ *
+ * \param[in] zone ECCX08_ZONE_CONFIG, ECCX08_ZONE_OTP or ECCX08_ZONE_DATA
+ * \param[in] slot slot of the data zone, ignored otherwise
+ * \param[in] offset first byte within the zone or slot
+ * \param[in] len number of bytes
+ * \param[out] dst buffer of len bytes
+ * \return status of the operation
+ */
+uint8_t AtEccX08::readZone(uint8_t zone, uint8_t slot, uint16_t offset,
+                           uint16_t len, uint8_t *dst)
+{
+  uint8_t ret_code = ECCX08_SUCCESS;
+
+  if (!dst || offset + len > zone_size(zone, slot))
+    return ECCX08_BAD_PARAM;
+
+  Session session(*this);
+  if (ECCX08_SUCCESS != session.status())
+    return session.status();
+
+  while (len > 0 && ECCX08_SUCCESS == ret_code)
+    {
+      bool block = (0 == offset % ECCX08_ZONE_ACCESS_32)
+        && len >= ECCX08_ZONE_ACCESS_32;
+      uint8_t skip = offset % ECCX08_ZONE_ACCESS_4;
+      uint8_t n = block ? ECCX08_ZONE_ACCESS_32 : ECCX08_ZONE_ACCESS_4 - skip;
+
+      if (n > len)
+        n = len;
+
+      ret_code =
+        this->execute(ecc_read(zone | (block ? ECCX08_ZONE_COUNT_FLAG : 0),
+                               zone_address(zone, slot, offset)));
+
+      if (ECCX08_SUCCESS == ret_code)
+        {
+          memcpy(dst, &this->temp[ECCX08_BUFFER_POS_DATA + skip], n);
+          dst += n;
+          offset += n;
+          len -= n;
+        }
+    }
+
+  return ret_code;
+}
+
+/** Write to a zone, or to a slot of the data zone, in one session. Whole
+ * blocks are written with 32 byte Writes, the rest with 4 byte Writes, so
+ * offset and len have to be multiples of 4.
+ *
+ * \param[in] zone ECCX08_ZONE_CONFIG, ECCX08_ZONE_OTP or ECCX08_ZONE_DATA
+ * \param[in] slot slot of the data zone, ignored otherwise
+ * \param[in] offset first byte within the zone or slot
+ * \param[in] len number of bytes
+ * \param[in] src len bytes to write
+ * \return status of the first failing Write, or ECCX08_SUCCESS
+ */
+uint8_t AtEccX08::writeZone(uint8_t zone, uint8_t slot, uint16_t offset,
+                            uint16_t len, const uint8_t *src)
+{
+  uint8_t ret_code = ECCX08_SUCCESS;
+
+  if (!src || offset + len > zone_size(zone, slot)
+      || offset % ECCX08_ZONE_ACCESS_4 || len % ECCX08_ZONE_ACCESS_4)
+    return ECCX08_BAD_PARAM;
+
+  Session session(*this);
+  if (ECCX08_SUCCESS != session.status())
+    return session.status();
+
+  this->rsp.clear();
+
+  if (ECCX08_ZONE_CONFIG == zone)
+    this->invalidateConfig();
+
+  while (len > 0 && ECCX08_SUCCESS == ret_code)
+    {
+      bool block = (0 == offset % ECCX08_ZONE_ACCESS_32)
+        && len >= ECCX08_ZONE_ACCESS_32;
+      uint8_t n = block ? ECCX08_ZONE_ACCESS_32 : ECCX08_ZONE_ACCESS_4;
+
+      ret_code =
+        this->execute(ecc_write(zone | (block ? ECCX08_ZONE_COUNT_FLAG : 0),
+                                zone_address(zone, slot, offset), n),
+                      const_cast<uint8_t *>(src));
+
+      src += n;
+      offset += n;
+      len -= n;
+    }
+
+  return ret_code;
+}
+
+/* Host side of an encrypted access: TempKey as GenDig leaves it, and for
+   a write the cipher text and input MAC. */
+struct EncryptedAccess
+{
+  uint8_t num_in[NONCE_NUMIN_SIZE];
+  const uint8_t *key;
+  uint16_t key_id;
+  struct sha204h_temp_key temp_key;
+  uint8_t status;
+
+  const uint8_t *plain;
+  uint8_t param1;
+  uint16_t address;
+  uint8_t cipher[32];
+  uint8_t mac[WRITE_MAC_SIZE];
+};
+
+/** The host computation of an encrypted access, run while the device
+ * executes GenDig on the TempKey the Nonce left. The input MAC is computed
+ * as in sha204h_encrypt(), which itself rejects data zone addresses past
+ * the first block of a slot.
+ */
+static void encrypted_access_host(void *context)
+{
+  EncryptedAccess *access = (EncryptedAccess *) context;
+  struct sha204h_gen_dig_in_out gen_dig =
+    { GENDIG_ZONE_DATA, access->key_id, const_cast<uint8_t *>(access->key),
+      &access->temp_key };
+
+  access->status = sha204h_gen_dig(&gen_dig);
+
+  if (SHA204_SUCCESS != access->status || NULL == access->plain)
+    return;
+
+  // TempKey{32} | OpCode{1} | Param1{1} | Param2{2} | SN8{1} | SN0_1{2}
+  // | 0{25} | PlainText{32}
+  uint8_t message[SHA204_MSG_SIZE_ENCRYPT_MAC];
+  uint8_t *p = message;
+
+  memcpy(p, access->temp_key.value, 32);
+  p += 32;
+  *p++ = ECCX08_WRITE;
+  *p++ = access->param1;
+  *p++ = access->address & 0xFF;
+  *p++ = access->address >> 8;
+  *p++ = SHA204_SN_8;
+  *p++ = SHA204_SN_0;
+  *p++ = SHA204_SN_1;
+  memset(p, 0, SHA204_GENDIG_ZEROS_SIZE);
+  p += SHA204_GENDIG_ZEROS_SIZE;
+  memcpy(p, access->plain, 32);
+
+  sha204h_calculate_sha256(sizeof(message), message, access->mac);
+
+  for (uint8_t i = 0; i < 32; i++)
+    access->cipher[i] = access->plain[i] ^ access->temp_key.value[i];
+
+  memset(message, 0, sizeof(message));
+}
+
+/** Nonce and GenDig with the key of an encrypted access, leaving the
+ * device and the host mirror with the same TempKey. The mirror follows
+ * each command as it completes; the host works out the GenDig step while
+ * the device runs it.
+ *
+ * \param[in,out] access key, key_id and for a write the data; the rest is
+ *                 filled in
+ * \param[in] worst_ms worst case time of the command that follows
+ * \return status of the operation
+ */
+uint8_t AtEccX08::beginEncrypted(EncryptedAccess &access, uint16_t worst_ms)
+{
+  uint8_t ret_code = this->randomBytes(access.num_in, sizeof(access.num_in));
+
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = this->beginFlow(NONCE_EXEC_MAX + GENDIG_EXEC_MAX + worst_ms);
+
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = this->execute(NONCE_RANDOM_NO_SEED, access.num_in);
+
+  if (ECCX08_SUCCESS != ret_code)
     return ret_code;
 
-  if (config_data) {
-    memcpy(config_data, &response[ECCX08_BUFFER_POS_DATA], ECCX08_ZONE_ACCESS_32);
-    config_data += ECCX08_ZONE_ACCESS_32;
-  }
+  struct sha204h_nonce_in_out nonce =
+    { NONCE_MODE_NO_SEED_UPDATE, access.num_in,
+      &this->temp[ECCX08_BUFFER_POS_DATA], &this->temp_key };
 
+  if (SHA204_SUCCESS != sha204h_nonce(&nonce))
+    return ECCX08_FUNC_FAIL;
 
-  eccX08p_sleep();
+  access.temp_key = this->temp_key;
+  access.status = ECCX08_FUNC_FAIL;
 
-  if (ret_code == ECCX08_SUCCESS && config_data) {
-    memcpy(config_data, &response[ECCX08_BUFFER_POS_DATA],
-           ECCX08_ZONE_ACCESS_32);
+  {
+    ExecutionHook hook(*this, encrypted_access_host, &access);
+    ret_code = this->execute(ecc_gendig(GENDIG_ZONE_DATA, access.key_id));
   }
 
+  if (ECCX08_SUCCESS == ret_code && SHA204_SUCCESS != access.status)
+    ret_code = ECCX08_FUNC_FAIL;
+
+  if (ECCX08_SUCCESS == ret_code)
+    this->temp_key = access.temp_key;
+
+  return ret_code;
+}
+
+/** Read a 32 byte block of a slot that is read encrypted. Nonce, GenDig
+ * and Read run in one session, and the host keeps a copy of TempKey
+ * in step to decrypt the block.
+ *
+ * \param[in] slot slot to read
+ * \param[in] block block of the slot
+ * \param[in] key_id slot of the read key, ReadKey in the slot config
+ * \param[in] key the 32 byte read key
+ * \param[out] dst 32 bytes of plain text
+ * \return status of the operation
+ */
+uint8_t AtEccX08::readEncrypted(uint8_t slot, uint8_t block, uint8_t key_id,
+                                const uint8_t *key, uint8_t *dst)
+{
+  uint16_t offset = (uint16_t) block * ECCX08_ZONE_ACCESS_32;
+
+  if (!key || !dst || slot > ECCX08_KEY_ID_MAX || key_id > ECCX08_KEY_ID_MAX
+      || offset + ECCX08_ZONE_ACCESS_32 > zone_size(ECCX08_ZONE_DATA, slot))
+    return ECCX08_BAD_PARAM;
+
+  EncryptedAccess access;
+
+  memset(&access, 0, sizeof(access));
+  access.key = key;
+  access.key_id = key_id;
+
+  Session session(*this);
+  uint8_t ret_code = session.status();
+
+  this->rsp.clear();
+
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = this->beginEncrypted(access, READ_EXEC_MAX);
+
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = this->execute(ecc_read(ECCX08_ZONE_DATA | ECCX08_ZONE_COUNT_FLAG,
+                                      zone_address(ECCX08_ZONE_DATA, slot,
+                                                   offset)));
+
+  if (ECCX08_SUCCESS == ret_code)
+    {
+      struct sha204h_decrypt_in_out decrypt = { dst, &this->temp_key };
+
+      memcpy(dst, &this->temp[ECCX08_BUFFER_POS_DATA], ECCX08_ZONE_ACCESS_32);
+      if (SHA204_SUCCESS != sha204h_decrypt(&decrypt))
+        ret_code = ECCX08_FUNC_FAIL;
+    }
+
+  memset(&access, 0, sizeof(access));
+  return ret_code;
+}
+
+/** Write a 32 byte block of a slot that is written encrypted, the
+ * counterpart of readEncrypted(). The data goes out encrypted with
+ * TempKey and with the MAC that proves knowledge of the write key.
+ *
+ * \param[in] slot slot to write
+ * \param[in] block block of the slot
+ * \param[in] key_id slot of the write key, WriteKey in the slot config
+ * \param[in] key the 32 byte write key
+ * \param[in] src 32 bytes of plain text
+ * \return status of the operation, ECCX08_STATUS_BYTE_MISCOMPARE if the
+ *         device rejected the MAC
+ */
+uint8_t AtEccX08::writeEncrypted(uint8_t slot, uint8_t block, uint8_t key_id,
+                                 const uint8_t *key, const uint8_t *src)
+{
+  uint16_t offset = (uint16_t) block * ECCX08_ZONE_ACCESS_32;
+
+  if (!key || !src || slot > ECCX08_KEY_ID_MAX || key_id > ECCX08_KEY_ID_MAX
+      || offset + ECCX08_ZONE_ACCESS_32 > zone_size(ECCX08_ZONE_DATA, slot))
+    return ECCX08_BAD_PARAM;
+
+  EncryptedAccess access;
+  EccParams write = ecc_write_encrypted(zone_address(ECCX08_ZONE_DATA, slot,
+                                                     offset));
+
+  memset(&access, 0, sizeof(access));
+  access.key = key;
+  access.key_id = key_id;
+  access.plain = src;
+  access.param1 = write.param1;
+  access.address = write.param2;
+
+  Session session(*this);
+  uint8_t ret_code = session.status();
+
+  this->rsp.clear();
+
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = this->beginEncrypted(access, WRITE_EXEC_MAX);
+
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = this->verifyResult(this->execute(write, access.cipher,
+                                                access.mac));
+
+  memset(&access, 0, sizeof(access));
   return ret_code;
 }
 
 bool AtEccX08::is_locked(const uint8_t ZONE)
 {
+  if (this->loadConfig(true) != ECCX08_SUCCESS)
+    return false;
+
+  if (ZONE == ECCX08_ZONE_CONFIG)
+    return 0 == this->config_cache[CONFIG_LOCK_CONFIG];
+
+  return 0 == this->config_cache[CONFIG_LOCK_VALUE];
+}
+
+/** Fill the configuration zone cache if needed.
+ *
+ * \param[in] lock_bytes true if bytes 84-89 are needed as well
+ * \return status of the operation
+ */
+uint8_t AtEccX08::loadConfig(bool lock_bytes)
+{
+  uint8_t ret_code = ECCX08_SUCCESS;
+
+  if (!(this->config_state & CONFIG_CACHE_STATIC))
+    {
+      ret_code = this->read_config_zone(this->config_cache);
+      if (ECCX08_SUCCESS == ret_code)
+        this->config_state = CONFIG_CACHE_STATIC | CONFIG_CACHE_LOCK_BYTES;
+    }
+  else if (lock_bytes && !(this->config_state & CONFIG_CACHE_LOCK_BYTES))
+    {
+      ret_code = this->wakeup();
+      if (ECCX08_SUCCESS == ret_code)
+        {
+          ret_code = this->executeFrame(&READ_CONFIG_64_FRAME);
+          this->idle();
+        }
+
+      if (ECCX08_SUCCESS == ret_code)
+        {
+          memcpy(&this->config_cache[ECCX08_ZONE_ACCESS_32 * 2],
+                 &this->temp[ECCX08_BUFFER_POS_DATA], ECCX08_ZONE_ACCESS_32);
+          this->config_state |= CONFIG_CACHE_LOCK_BYTES;
+        }
+    }
+
+  return ret_code;
+}
+
+/** Drop what a command may have changed in the configuration zone. All of
+ * it while the zone is unlocked, otherwise bytes 84-89 only. Call this as
+ * well if another host changes the device.
+ */
+void AtEccX08::invalidateConfig()
+{
+  if (!(this->config_state & CONFIG_CACHE_STATIC)
+      || 0 != this->config_cache[CONFIG_LOCK_CONFIG])
+    this->config_state = 0;
+  else
+    this->config_state &= ~CONFIG_CACHE_LOCK_BYTES;
+}
+
+/** Value of a monotonic counter. Only the first read of a counter goes to
+ * the device, later ones return what this object last read or counted.
+ *
+ * \param[in] counter 0 or 1
+ * \param[out] value the counter
+ * \return status of the operation
+ */
+uint8_t AtEccX08::counterRead(uint8_t counter, uint32_t &value)
+{
+  if (counter > 1)
+    return ECCX08_BAD_PARAM;
+
+  uint8_t ret_code = ECCX08_SUCCESS;
+
+  if (!(this->counter_state & (1 << counter)))
+    {
+      ret_code = this->wakeup();
+      if (ECCX08_SUCCESS != ret_code)
+        return ret_code;
+
+      ret_code = this->counterCommand(counter, false);
+      this->idle();
+    }
+
+  if (ECCX08_SUCCESS == ret_code)
+    value = this->counter_cache[counter];
+
+  return ret_code;
+}
+
+/** Increment a monotonic counter n times in one session. Counters stop at
+ * 2097151 and every increment is an EEPROM write.
+ *
+ * \param[in] counter 0 or 1
+ * \param[in] n number of increments
+ * \param[out] value the counter afterwards, may be NULL
+ * \return status of the operation, on failure the counter may have been
+ *         incremented fewer than n times
+ */
+uint8_t AtEccX08::counterIncrement(uint8_t counter, uint32_t n,
+                                   uint32_t *value)
+{
+  if (counter > 1)
+    return ECCX08_BAD_PARAM;
+
+  Session session(*this);
+  uint8_t ret_code = session.status();
+
+  for (uint32_t i = 0; ECCX08_SUCCESS == ret_code && i < n; i++)
+    {
+      ret_code = this->beginFlow(COUNTER_EXEC_MAX);
+      if (ECCX08_SUCCESS == ret_code)
+        ret_code = this->counterCommand(counter, true);
+    }
+
+  if (ECCX08_SUCCESS == ret_code && NULL != value)
+    ret_code = this->counterRead(counter, *value);
+
+  return ret_code;
+}
+
+/** Drop the cached counter values, for when another host or a key use
+ * limit counts as well.
+ */
+void AtEccX08::invalidateCounters()
+{
+  this->counter_state = 0;
+}
+
+/** Run one Counter command and cache the value it returns. The response
+ * goes to a local buffer, rsp is left alone.
+ *
+ * \param[in] counter 0 or 1
+ * \param[in] increment true to increment, false to read
+ * \return status of the operation
+ */
+uint8_t AtEccX08::counterCommand(uint8_t counter, bool increment)
+{
+  uint8_t rx[COUNTER_RSP_SIZE];
+  uint8_t ret_code = this->executeFrame(&COUNTER_FRAMES[counter][increment],
+                                        rx, sizeof(rx));
+
+  if (ECCX08_SUCCESS == ret_code)
+    {
+      const uint8_t *data = &rx[ECCX08_BUFFER_POS_DATA];
+
+      this->counter_cache[counter] = (uint32_t) data[0]
+        | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16)
+        | ((uint32_t) data[3] << 24);
+      this->counter_state |= 1 << counter;
+    }
+  else
+    {
+      // An increment may or may not have happened.
+      this->counter_state &= ~(1 << counter);
+    }
+
+  return ret_code;
+}
+
+uint8_t AtEccX08::getSlotConfig(uint8_t slot, uint16_t &slot_config)
+{
+  if (slot > ECCX08_KEY_ID_MAX)
+    return ECCX08_BAD_PARAM;
+
+  uint8_t ret_code = this->loadConfig(false);
+
+  if (ECCX08_SUCCESS == ret_code)
+    slot_config = this->config_cache[CONFIG_SLOT_CONFIG + 2 * slot]
+      | (this->config_cache[CONFIG_SLOT_CONFIG + 2 * slot + 1] << 8);
+
+  return ret_code;
+}
+
+uint8_t AtEccX08::getKeyConfig(uint8_t slot, uint16_t &key_config)
+{
+  if (slot > ECCX08_KEY_ID_MAX)
+    return ECCX08_BAD_PARAM;
+
+  uint8_t ret_code = this->loadConfig(false);
 
-  uint16_t config_address = ECCX08_ZONE_ACCESS_32 * 2;
+  if (ECCX08_SUCCESS == ret_code)
+    key_config = this->config_cache[CONFIG_KEY_CONFIG + 2 * slot]
+      | (this->config_cache[CONFIG_KEY_CONFIG + 2 * slot + 1] << 8);
+
+  return ret_code;
+}
+
+// Bit n is clear if slot n is locked.
+uint8_t AtEccX08::getSlotLocked(uint16_t &slot_locked)
+{
+  uint8_t ret_code = this->loadConfig(true);
+
+  if (ECCX08_SUCCESS == ret_code)
+    slot_locked = this->config_cache[CONFIG_SLOT_LOCKED]
+      | (this->config_cache[CONFIG_SLOT_LOCKED + 1] << 8);
+
+  return ret_code;
+}
+
+int AtEccX08::load_nonce(uint8_t *to_load, int len)
+{
+  // Pass the message to be signed using Nonce command with mode =
+  // 0x03.
   uint8_t *rsp_ptr = &this->temp[ECCX08_BUFFER_POS_DATA];
-  /* Offset to lock byte */
-  uint8_t offset = 22;
-  bool status = false;
-  uint8_t ret_code;
 
   this->rsp.clear();
 
-  ret_code = this->wakeup();
-  if (ret_code != ECCX08_SUCCESS)
-    return false;
+  this->wakeup();
+
+  int ret_code = this->execute(ecc_nonce(NONCE_MODE_PASSTHROUGH, len), to_load);
+
+  this->idle();
+
+  return ret_code;
+}
+
+int AtEccX08::sign_tempkey(const uint8_t KEY_ID)
+{
+  this->rsp.clear();
+
+  this->wakeup();
+
+  int ret_code = this->execute(ecc_sign(SIGN_MODE_EXTERNAL, KEY_ID));
+
+  this->idle();
+
+//  debugStream->print("sign_tempkey: ");
+//  debugStream->println( ret_code, HEX);
+
+  return ret_code;
+
+}
+
+
+uint8_t AtEccX08::sign(uint8_t key, uint8_t *data, int len_32)
+{
+  this->rsp.clear();
+
+  uint8_t ret_code = this->signCommand(key, data, len_32);
+
+  if (ECCX08_SUCCESS == ret_code)
+    this->rsp.copyBufferFrom(&this->temp[ECCX08_BUFFER_POS_DATA],
+                             VERIFY_256_SIGNATURE_SIZE);
+
+  return ret_code;
+}
+
+// Same without the copy to rsp, signature points into the receive buffer.
+uint8_t AtEccX08::sign(uint8_t key, uint8_t *data, int len_32,
+                       Signature &signature)
+{
+  uint8_t ret_code = this->signCommand(key, data, len_32);
+
+  signature = Signature(ECCX08_SUCCESS == ret_code
+                        ? &this->temp[ECCX08_BUFFER_POS_DATA] : NULL);
+  return ret_code;
+}
+
+// Nonce and Sign, with a seed update when due. The signature is left in
+// the receive buffer.
+uint8_t AtEccX08::signCommand(uint8_t key, uint8_t *data, int len_32)
+{
+  const uint8_t * const inputs[] = { data };
+  const uint16_t args[] = { key };
+  bool update_seed = this->seedUpdateDue();
+  uint8_t skip = update_seed ? 0 : 1;
+
+  if (NONCE_NUMIN_SIZE_PASSTHROUGH != len_32)
+    return ECCX08_BAD_PARAM;
+
+  uint8_t ret_code = this->runScript(SIGN_SCRIPT + skip,
+                                     SCRIPT_LENGTH(SIGN_SCRIPT) - skip,
+                                     inputs, NULL, args);
+
+  if (ECCX08_SUCCESS == ret_code)
+    {
+      if (update_seed)
+        this->signs_left = this->seed_interval;
+      if (this->signs_left)
+        this->signs_left--;
+    }
+
+  return ret_code;
+}
+
+/** Whether a failed item of a batch leaves the rest worth trying: CRC
+ * errors and unknown status (an ECC fault) may not repeat, errors of the
+ * command itself or of the bus will.
+ */
+static bool batch_item_error(uint8_t ret_code)
+{
+  return ECCX08_STATUS_CRC == ret_code || ECCX08_BAD_CRC == ret_code
+    || ECCX08_STATUS_UNKNOWN == ret_code;
+}
 
-  this->rsp.clear();
+/* The Nonce pass-through packet of a batch item, CRC included. */
+struct BatchNonce
+{
+  const uint8_t *pending;
+  const uint8_t *built;
+  uint8_t frame[ECCX08_CMD_SIZE_MIN + NONCE_NUMIN_SIZE_PASSTHROUGH];
+};
 
-  ret_code = eccX08m_execute(ECCX08_READ,
-                             ECCX08_ZONE_CONFIG | ECCX08_ZONE_COUNT_FLAG,
-                             config_address >> 2,
-                             0, NULL, 0, NULL, 0, NULL, sizeof(this->command),
-                             this->command,
-                             sizeof(this->temp), this->temp);
+/** Build the Nonce packet of the pending digest. Run while the device
+ * executes the Sign of the item before.
+ */
+static void build_batch_nonce(void *context)
+{
+  BatchNonce *nonce = (BatchNonce *) context;
+  uint8_t *p = nonce->frame;
+
+  *p++ = sizeof(nonce->frame);
+  *p++ = NONCE_PASSTHROUGH.op_code;
+  *p++ = NONCE_PASSTHROUGH.param1;
+  *p++ = NONCE_PASSTHROUGH.param2 & 0xFF;
+  *p++ = NONCE_PASSTHROUGH.param2 >> 8;
+  memcpy(p, nonce->pending, NONCE_PASSTHROUGH.data1_len);
+  eccX08c_calculate_crc(sizeof(nonce->frame) - ECCX08_CRC_SIZE, nonce->frame,
+                        nonce->frame + sizeof(nonce->frame) - ECCX08_CRC_SIZE);
+
+  nonce->built = nonce->pending;
+}
 
-  this->idle();
+/** Sign a number of digests with one key in a single session, a Nonce and
+ * Sign pair each. While the device runs a Sign the host builds the Nonce
+ * packet of the next digest, so between two signatures only that packet
+ * has to go over the bus. The seed is updated as sign() would, so at most
+ * once per interval. The batch stops at the first error that would repeat.
+ *
+ * \param[in] key private key slot
+ * \param[in] digests n digests of 32 bytes
+ * \param[in] n number of digests
+ * \param[out] signatures n signatures of 64 bytes
+ * \param[out] status n item statuses, ECCX08_FUNC_FAIL for the items not
+ *             tried; may be NULL
+ * \return ECCX08_SUCCESS if all were signed, else the first error
+ */
+uint8_t AtEccX08::signBatch(uint8_t key, const uint8_t digests[][32],
+                            uint8_t n, uint8_t signatures[][64],
+                            uint8_t *status)
+{
+  uint8_t ret_code = ECCX08_SUCCESS;
+  uint8_t nonce_rsp[NONCE_RSP_SIZE_SHORT];
+  BatchNonce next;
 
-  if (ret_code != ECCX08_SUCCESS)
-    return false;
+  if (status)
+    memset(status, ECCX08_FUNC_FAIL, n);
 
-  if (ZONE == ECCX08_ZONE_CONFIG)
-    {
-      /* config zone is at offset 23 */
-      offset++;
-    }
+  if (!ecc_valid_slot(key))
+    return ECCX08_BAD_PARAM;
 
-  if (0 == *(rsp_ptr + offset))
-    status = true;
+  Session session(*this);
+  if (ECCX08_SUCCESS != session.status())
+    return session.status();
 
-  return status;
-}
+  // The Nonce packets don't pass through the tx buffer commandDone() reads.
+  this->temp_key.valid = 0;
+  next.built = NULL;
 
-int AtEccX08::load_nonce(uint8_t *to_load, int len)
-{
-  // Pass the message to be signed using Nonce command with mode =
-  // 0x03.
-  uint8_t *rsp_ptr = &this->temp[ECCX08_BUFFER_POS_DATA];
+  for (uint8_t i = 0; i < n; i++)
+    {
+      bool update_seed = this->seedUpdateDue();
+      uint8_t item = this->beginFlow((update_seed ? RANDOM_EXEC_MAX : 0)
+                                     + NONCE_EXEC_MAX + SIGN_EXEC_MAX);
 
-  this->rsp.clear();
+      // Only the first packet, or one a failed Sign did not get to, is
+      // built here.
+      if (next.built != digests[i])
+        {
+          next.pending = digests[i];
+          build_batch_nonce(&next);
+        }
 
-  this->wakeup();
+      if (ECCX08_SUCCESS == item && update_seed)
+        item = this->executeFrame(&RANDOM_SEED_FRAME);
 
-  int ret_code =
-    eccX08m_execute(ECCX08_NONCE,
-                    NONCE_MODE_PASSTHROUGH,
-                    NONCE_ZERO_RANDOM_OUT,
-                    NONCE_NUMIN_SIZE_PASSTHROUGH,
-                    to_load,
-                    0, NULL, 0, NULL,
-                    sizeof(this->command), this->command,
-                    sizeof(this->temp), this->temp);
+      if (ECCX08_SUCCESS == item)
+        item = this->commandDone(eccX08m_execute_frame(next.frame,
+                                                       sizeof(nonce_rsp),
+                                                       nonce_rsp));
 
-  this->idle();
+      if (ECCX08_SUCCESS == item)
+        {
+          next.pending = i + 1 < n ? digests[i + 1] : NULL;
 
-  return ret_code;
-}
+          ExecutionHook hook(*this, next.pending ? build_batch_nonce : NULL,
+                             &next);
+          item = this->execute(ecc_sign(SIGN_MODE_EXTERNAL, key));
+        }
 
-int AtEccX08::sign_tempkey(const uint8_t KEY_ID)
-{
-  this->rsp.clear();
+      if (ECCX08_SUCCESS == item)
+        {
+          memcpy(signatures[i], &this->temp[ECCX08_BUFFER_POS_DATA], 64);
 
-  this->wakeup();
+          if (update_seed)
+            this->signs_left = this->seed_interval;
+          if (this->signs_left)
+            this->signs_left--;
+        }
 
-  int ret_code =
-    eccX08m_execute(ECCX08_SIGN,
-                    SIGN_MODE_EXTERNAL,
-                    KEY_ID,
-                    0, NULL, 0, NULL, 0, NULL,
-                    sizeof(this->command), this->command,
-                    sizeof(this->temp), this->temp);
+      if (status)
+        status[i] = item;
 
-  this->idle();
+      if (ECCX08_SUCCESS != item && ECCX08_SUCCESS == ret_code)
+        ret_code = item;
 
-//  debugStream->print("sign_tempkey: ");
-//  debugStream->println( ret_code, HEX);
+      if (ECCX08_SUCCESS != item && !batch_item_error(item))
+        break;
+    }
 
   return ret_code;
-
 }
 
+/** Keep public keys in the EEPROM of the MCU, so genEccKey(slot, false)
+ * only runs GenKey the first time for a slot. See PublicKeyCache.
+ *
+ * \param[in] eeprom_address first EEPROM byte of the cache, it takes
+ *            PublicKeyCache::size(entries) bytes
+ * \param[in] entries number of keys kept, 0 to disable the cache
+ */
+void AtEccX08::enableKeyCache(uint16_t eeprom_address, uint8_t entries)
+{
+  this->key_cache.begin(eeprom_address, entries);
+}
 
-uint8_t AtEccX08::sign(uint8_t key, uint8_t *data, int len_32)
+/** Generate a private key and return its public key, or return the public
+ * key of a slot. With the key cache enabled the public key comes from the
+ * cache when it holds one for this device and slot, and a new private key
+ * drops the cached one.
+ */
+uint8_t AtEccX08::genEccKey(const uint8_t KEY_ID, bool privateKey)
 {
-  uint8_t *rsp_ptr = &this->temp[ECCX08_BUFFER_POS_DATA];
+  this->rsp.clear();
 
-  int ret_code = this->getRandom(true);
+  uint8_t ret_code = this->genKeyCommand(KEY_ID, privateKey);
 
   if (ECCX08_SUCCESS == ret_code)
-    {
-      if ((ret_code = this->load_nonce(data, len_32)) == ECCX08_SUCCESS)
-        {
-          if ((ret_code = this->sign_tempkey(key)) == ECCX08_SUCCESS)
-            {
-              this->rsp.copyBufferFrom(rsp_ptr, VERIFY_256_SIGNATURE_SIZE);
-            }
-        }
-    }
+    this->rsp.copyBufferFrom(&this->temp[ECCX08_BUFFER_POS_DATA],
+                             VERIFY_256_KEY_SIZE);
 
   return ret_code;
+}
 
+// Same without the copy to rsp, pub_key points into the receive buffer.
+uint8_t AtEccX08::genEccKey(const uint8_t KEY_ID, bool privateKey,
+                            PublicKey &pub_key)
+{
+  uint8_t ret_code = this->genKeyCommand(KEY_ID, privateKey);
 
+  pub_key = PublicKey(ECCX08_SUCCESS == ret_code
+                      ? &this->temp[ECCX08_BUFFER_POS_DATA] : NULL);
+  return ret_code;
 }
 
-/** 
- *
- *
- */
-uint8_t AtEccX08::genEccKey(const uint8_t KEY_ID, bool privateKey)
+// GenKey, or a key cache hit. The public key is left in the receive buffer.
+uint8_t AtEccX08::genKeyCommand(uint8_t KEY_ID, bool privateKey)
 {
   uint8_t *rsp_ptr = &this->temp[ECCX08_BUFFER_POS_DATA];
+  uint8_t serial[9];
+  bool cached = this->key_cache.enabled()
+    && ECCX08_SUCCESS == this->loadSerialNumber();
 
-  this->rsp.clear();
+  if (cached)
+    memcpy(serial, rsp_ptr, sizeof(serial));
+
+  // Without the serial number the slot is dropped for every device.
+  if (privateKey)
+    this->key_cache.invalidate(cached ? serial : NULL, KEY_ID);
+  else if (cached && this->key_cache.lookup(serial, KEY_ID, rsp_ptr))
+    return ECCX08_SUCCESS;
 
   this->wakeup();
 
-  int ret_code =
-    eccX08m_execute(ECCX08_GENKEY, privateKey ? GENKEY_MODE_PRIVATE : GENKEY_MODE_PUBLIC,
-                    KEY_ID, 0, NULL, 0, NULL, 0, NULL,
-                    sizeof(this->command), this->command,
-                    sizeof(this->temp), this->temp);
+  uint8_t ret_code =
+    this->execute(ecc_genkey(privateKey ? GENKEY_MODE_PRIVATE : GENKEY_MODE_PUBLIC,
+                             KEY_ID));
 
-  if (0 == ret_code)
-    this->rsp.copyBufferFrom(rsp_ptr, VERIFY_256_KEY_SIZE);
+  this->idle();
+
+  if (0 == ret_code && cached)
+    this->key_cache.store(serial, KEY_ID, rsp_ptr);
 
 //  debugStream->print("genPrivateKey: ");
 //  debugStream->println( ret_code, HEX);
@@ -586,14 +1911,9 @@ uint8_t AtEccX08::verify_tempkey( uint8_t *pub_key,
   this->wakeup();
 
   int ret_code =
-    eccX08m_execute(ECCX08_VERIFY, VERIFY_MODE_EXTERNAL,
-                    VERIFY_KEY_P256, VERIFY_256_SIGNATURE_SIZE,
-                    signature,
-                    VERIFY_256_KEY_SIZE,
-                    pub_key, 0, NULL,
-                    sizeof(this->command), command,
-                    sizeof(this->temp),
-                    this->temp);
+    this->execute(ecc_verify_external(VERIFY_256_SIGNATURE_SIZE,
+                                      VERIFY_256_KEY_SIZE),
+                  signature, pub_key);
 
   if (0 == ret_code)
     {
@@ -611,43 +1931,254 @@ uint8_t AtEccX08::verify(uint8_t *data, int len_32,
                          uint8_t *pub_key,
                          uint8_t *signature)
 {
-  int ret_code = -1;
+  const uint8_t * const inputs[] = { data, signature, pub_key };
+
+  if (NONCE_NUMIN_SIZE_PASSTHROUGH != len_32)
+    return ECCX08_BAD_PARAM;
+
+  uint8_t ret_code = this->runScript(VERIFY_SCRIPT, SCRIPT_LENGTH(VERIFY_SCRIPT),
+                                     inputs, NULL, NULL);
+
+  return this->verifyResult(ret_code);
+}
+
+/** A Verify that does not match answers with status 1, which the
+ * communication layer passes as success. Return that status byte, as
+ * verify() always has.
+ */
+uint8_t AtEccX08::verifyResult(uint8_t ret_code)
+{
+  if (ECCX08_SUCCESS == ret_code)
+    return this->temp[ECCX08_BUFFER_POS_STATUS];
+
+  return ret_code;
+}
+
+/** Store a trusted public key for verifyStored(). The key is written in
+ * the padded layout of the Verify command, four zero bytes ahead of X and
+ * of Y. The slot has to be configured to hold a public key and to allow
+ * clear writes.
+ *
+ * \param[in] slot 8 to 15, the slots large enough for a P256 key
+ * \param[in] pub_key X and Y, 64 bytes
+ * \return status of the operation
+ */
+uint8_t AtEccX08::pinPublicKey(uint8_t slot, const uint8_t *pub_key)
+{
+  uint8_t padded[2 * (ECCX08_ZONE_ACCESS_4 + VERIFY_256_KEY_SIZE / 2)];
+
+  if (slot < 8 || slot > ECCX08_KEY_ID_MAX || !pub_key)
+    return ECCX08_BAD_PARAM;
+
+  memset(padded, 0, sizeof(padded));
+  memcpy(&padded[ECCX08_ZONE_ACCESS_4], pub_key, VERIFY_256_KEY_SIZE / 2);
+  memcpy(&padded[sizeof(padded) / 2 + ECCX08_ZONE_ACCESS_4],
+         &pub_key[VERIFY_256_KEY_SIZE / 2], VERIFY_256_KEY_SIZE / 2);
+
+  return this->writeZone(ECCX08_ZONE_DATA, slot, 0, sizeof(padded), padded);
+}
+
+/** Verify a signature against a public key pinned in a slot. Only the
+ * signature goes over the bus, not the key.
+ *
+ * \param[in] slot slot of the public key
+ * \param[in] digest 32 byte digest
+ * \param[in] signature 64 byte signature
+ * \return ECCX08_SUCCESS, ECCX08_STATUS_BYTE_MISCOMPARE if the signature
+ *         does not match, or the status of the operation
+ */
+uint8_t AtEccX08::verifyStored(uint8_t slot, const uint8_t *digest,
+                               const uint8_t *signature)
+{
+  const uint8_t * const inputs[] = { digest, signature };
+  const uint16_t args[] = { slot };
+
+  if (!ecc_valid_slot(slot))
+    return ECCX08_BAD_PARAM;
+
+  uint8_t ret_code = this->runScript(VERIFY_STORED_SCRIPT,
+                                     SCRIPT_LENGTH(VERIFY_STORED_SCRIPT),
+                                     inputs, NULL, args);
+
+  return this->verifyResult(ret_code);
+}
+
+/** Verify a number of signatures against a pinned public key in a single
+ * session. A signature that does not match is reported and the batch goes
+ * on; it stops at the first error that would repeat.
+ *
+ * \param[in] slot slot of the public key
+ * \param[in] digests n digests of 32 bytes
+ * \param[in] n number of digests
+ * \param[in] signatures n signatures of 64 bytes
+ * \param[out] status n item statuses as of verifyStored(),
+ *             ECCX08_FUNC_FAIL for the items not tried; may be NULL
+ * \return ECCX08_SUCCESS if all matched, else the first failure
+ */
+uint8_t AtEccX08::verifyBatch(uint8_t slot, const uint8_t digests[][32],
+                              uint8_t n, const uint8_t signatures[][64],
+                              uint8_t *status)
+{
+  uint8_t ret_code = ECCX08_SUCCESS;
+
+  if (status)
+    memset(status, ECCX08_FUNC_FAIL, n);
+
+  Session session(*this);
+  if (ECCX08_SUCCESS != session.status())
+    return session.status();
+
+  for (uint8_t i = 0; i < n; i++)
+    {
+      uint8_t item = this->verifyStored(slot, digests[i], signatures[i]);
+
+      if (status)
+        status[i] = item;
+
+      if (ECCX08_SUCCESS != item && ECCX08_SUCCESS == ret_code)
+        ret_code = item;
+
+      if (ECCX08_SUCCESS != item && ECCX08_STATUS_BYTE_MISCOMPARE != item
+          && !batch_item_error(item))
+        break;
+    }
+
+  return ret_code;
+}
+
+/** Agree on a shared secret with a peer using the private key in a slot,
+ * one ECDH command. Depending on the slot configuration the device either
+ * returns the secret or writes it to the next slot.
+ *
+ * \param[in] slot slot of the private key
+ * \param[in] peer_pub_key the peer's public key, X and Y of 32 bytes
+ * \param[out] shared_secret 32 bytes for the X coordinate of the shared
+ *             point, NULL if the slot keeps it in the device
+ * \return status of the operation, ECCX08_FUNC_FAIL if shared_secret was
+ *         given but the slot did not release the secret
+ */
+uint8_t AtEccX08::ecdh(uint8_t slot, const uint8_t *peer_pub_key,
+                       uint8_t *shared_secret)
+{
+  this->rsp.clear();
+
+  if (NULL == peer_pub_key)
+    return ECCX08_BAD_PARAM;
+
+  uint8_t ret_code = this->beginFlow(ECDH_EXEC_MAX);
+
+  if (ECCX08_SUCCESS != ret_code)
+    return ret_code;
+
+  ret_code = this->execute(ecc_ecdh(slot, ECDH_PUB_KEY_SIZE),
+                           const_cast<uint8_t *>(peer_pub_key));
 
-  if ((ret_code = this->load_nonce(data, len_32)) == ECCX08_SUCCESS)
+  if (ECCX08_SUCCESS == ret_code && NULL != shared_secret)
     {
-      ret_code = this->verify_tempkey( pub_key, signature);
+      if (ECDH_RSP_SIZE_LONG == this->temp[ECCX08_BUFFER_POS_COUNT])
+        memcpy(shared_secret, &this->temp[ECCX08_BUFFER_POS_DATA], 32);
+      else
+        ret_code = ECCX08_FUNC_FAIL;
     }
-//  else
-//    Serial.print("\nNonce failed to Loaded");
 
+  // The secret is not left behind in the response buffer.
+  memset(this->temp, 0, sizeof(this->temp));
+
+  this->idle();
+  return ret_code;
+}
+
+/** ECDH followed by HKDF-SHA256 of the shared secret, for a session key in
+ * a single wake-up. The secret itself only exists on the stack meanwhile,
+ * so the slot has to release it (see ecdh()).
+ *
+ * \param[in] slot slot of the private key
+ * \param[in] peer_pub_key the peer's public key
+ * \param[in] salt HKDF salt, e.g. both nonces of the handshake; may be NULL
+ * \param[in] salt_len its length
+ * \param[in] info HKDF info, what the key is for; may be NULL
+ * \param[in] info_len its length
+ * \param[out] key key_len bytes of key material
+ * \param[in] key_len how many
+ * \return status of the ECDH command
+ */
+uint8_t AtEccX08::deriveSessionKey(uint8_t slot, const uint8_t *peer_pub_key,
+                                   const uint8_t *salt, uint8_t salt_len,
+                                   const uint8_t *info, uint8_t info_len,
+                                   uint8_t *key, uint8_t key_len)
+{
+  uint8_t secret[32];
+  uint8_t ret_code = this->ecdh(slot, peer_pub_key, secret);
+
+  if (ECCX08_SUCCESS == ret_code)
+    hkdf_sha256(salt, salt_len, secret, sizeof(secret), info, info_len,
+                key, key_len);
+
+  memset(secret, 0, sizeof(secret));
   return ret_code;
 }
 
-// This doesnt generate correct SHA256 HAsh
+/** Verify a signature over a message in memory, hashed with the cheapest
+ * SHA-256 backend (see Sha256Hash).
+ *
+ * \param[in] data the message
+ * \param[in] len its length in bytes
+ * \param[in] pub_key public key, X and Y of 32 bytes
+ * \param[in] signature R and S of 32 bytes
+ * \return status of the operation, ECCX08_STATUS_BYTE_MISCOMPARE if the
+ *         signature does not match
+ */
 uint8_t
 AtEccX08::hash_verify(const uint8_t *data, int len, uint8_t *pub_key,
                       uint8_t *signature)
 {
+  uint8_t digest[32];
 
-  sha256_hash_t digest;
-  sha256(&digest, data, len);
+  if (len < 0)
+    return ECCX08_BAD_PARAM;
 
-  Serial.write("\n");
-  for (int i = 0; i < len; i++)
-    {
-      static char tmp[4] = {};
-      if (i > 0)
-        Serial.write(" ");
+  Sha256Hash hasher(this, this->hash_costs);
+  uint8_t ret_code = hasher.hash(data, len, digest);
 
-      sprintf(tmp, "0x%02X", digest[i]);
-      Serial.write(tmp);
-    }
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = this->verify(digest, sizeof(digest), pub_key, signature);
+
+  return ret_code;
+}
 
-  Serial.write("\n");
+/** Verify a signature over an image that is read block by block, e.g. a
+ * firmware image before it is booted. The image is hashed as it is read,
+ * with the cheapest backend that streams, and only the digest goes to the
+ * device for one Verify.
+ *
+ * \param[in] reader reads the image
+ * \param[in] context passed to reader
+ * \param[in] len image length in bytes
+ * \param[in] pub_key public key, X and Y of 32 bytes
+ * \param[in] signature R and S of 32 bytes
+ * \return status of the reader or of the operation,
+ *         ECCX08_STATUS_BYTE_MISCOMPARE if the signature does not match
+ */
+uint8_t AtEccX08::verifyImage(ImageReader reader, void *context, uint32_t len,
+                              uint8_t *pub_key, uint8_t *signature)
+{
+  uint8_t digest[32];
+  Sha256Hash hasher(this, this->hash_costs);
+  uint8_t ret_code = hasher.hash(reader, context, len, digest);
 
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = this->verify(digest, sizeof(digest), pub_key, signature);
 
-  return this->verify (&digest[0], sizeof(digest), pub_key, signature);
+  return ret_code;
+}
 
+/** Replace the estimated cost of a SHA-256 backend for hash_verify() and
+ * verifyImage(), see Sha256Costs::set().
+ */
+void AtEccX08::setHashCost(Sha256Backend backend, uint16_t fixed_us,
+                           uint16_t block_us)
+{
+  this->hash_costs.set(backend, fixed_us, block_us);
 }
 
 
@@ -667,41 +2198,40 @@ void AtEccX08::enableIdleWake()
 
 uint8_t AtEccX08::getSerialNumber(void)
 {
-
-  uint8_t *rsp_ptr = &this->temp[ECCX08_BUFFER_POS_DATA];
-
   this->rsp.clear();
 
-  uint8_t ret_code = this->wakeup();
+  uint8_t ret_code = this->loadSerialNumber();
 
-  if (ret_code != ECCX08_SUCCESS)
-    return ret_code;
+  if (0 == ret_code)
+    this->rsp.copyBufferFrom(&this->temp[ECCX08_BUFFER_POS_DATA],
+                             SerialNumber::SIZE);
 
-  memset(this->temp, 0, sizeof(this->temp));
+  return ret_code;
+}
 
-  uint8_t config_address = 0;
+// Same without the copy to rsp, serial points into the receive buffer.
+uint8_t AtEccX08::getSerialNumber(SerialNumber &serial)
+{
+  uint8_t ret_code = this->loadSerialNumber();
 
-  ret_code = eccX08m_execute(ECCX08_READ,
-                             ECCX08_ZONE_CONFIG | ECCX08_ZONE_COUNT_FLAG,
-                             config_address >> 2,
-                             0, NULL, 0, NULL, 0, NULL, sizeof(this->command),
-                             this->command,
-                             sizeof(this->temp), this->temp);
+  serial = SerialNumber(ECCX08_SUCCESS == ret_code
+                        ? &this->temp[ECCX08_BUFFER_POS_DATA] : NULL);
+  return ret_code;
+}
 
+// The 9 byte serial number, assembled in the receive buffer.
+uint8_t AtEccX08::loadSerialNumber()
+{
+  uint8_t *rsp_ptr = &this->temp[ECCX08_BUFFER_POS_DATA];
 
-  const uint8_t SERIAL_NUM_LENGTH = 9;
+  uint8_t ret_code = this->loadConfig(false);
 
   if (0 == ret_code) {
-    //this->rsp.copyBufferFrom(rsp_ptr, READ_32_RSP_SIZE);  // VERIFY_256_KEY_SIZE);  // READ_32_RSP_SIZE
-    uint8_t tmpSn[9];
-    memcpy(tmpSn, &rsp_ptr[0], 4);
-    memcpy(tmpSn + 4, &rsp_ptr[8], 5);
-    this->rsp.copyBufferFrom(tmpSn, 9);
+    // SN[0:3] are at bytes 0-3 and SN[4:8] at bytes 8-12.
+    memcpy(&rsp_ptr[0], &this->config_cache[0], 4);
+    memcpy(&rsp_ptr[4], &this->config_cache[8], 5);
   }
 
-
-  this->idle();
-
   return ret_code;
 }
 
@@ -720,12 +2250,10 @@ uint8_t AtEccX08::getInfo(uint8_t info, uint16_t key_id)
 
   memset(this->temp, 0, sizeof(this->temp));
 
-  ret_code = eccX08m_execute(ECCX08_INFO,
-                             info,    //INFO_MODE_REVISION ,     // Param1, 8 bits
-                             key_id,    //0,                       // Param2, 16 bits
-                             0, NULL, 0, NULL, 0, NULL, sizeof(this->command),
-                             this->command,
-                             sizeof(this->temp), this->temp);
+  if (INFO_MODE_REVISION == info && 0 == key_id)
+    ret_code = this->executeFrame(&INFO_REVISION_FRAME);
+  else
+    ret_code = this->execute(ecc_info(info, key_id));
 
   if (0 == ret_code) {
     this->rsp.copyBufferFrom(rsp_ptr, INFO_RSP_SIZE);
@@ -738,85 +2266,170 @@ uint8_t AtEccX08::getInfo(uint8_t info, uint16_t key_id)
 
 uint8_t AtEccX08::getKeySlotConfig(void)
 {
-
-  uint8_t *rsp_ptr = &this->temp[ECCX08_BUFFER_POS_DATA];
-
   this->rsp.clear();
 
-  uint8_t ret_code = this->wakeup();
-  if (ret_code != ECCX08_SUCCESS)
-    return ret_code;
-
-  memset(this->temp, 0, sizeof(this->temp));
-
-  ret_code = eccX08m_execute(ECCX08_READ,
-                             ECCX08_ZONE_CONFIG | ECCX08_ZONE_COUNT_FLAG,
-                             64 >> 2,
-                             0, NULL, 0, NULL, 0, NULL, sizeof(this->command),
-                             this->command, sizeof(this->temp), this->temp);
+  uint8_t ret_code = this->loadConfig(true);
 
   if (0 == ret_code) {
-    this->rsp.copyBufferFrom(rsp_ptr+24, 2);    //READ_32_RSP_SIZE);  // VERIFY_256_KEY_SIZE);  // READ_32_RSP_SIZE
+    this->rsp.copyBufferFrom(&this->config_cache[CONFIG_SLOT_LOCKED], 2);
   }
 
-  this->idle();
-
   return ret_code;
 }
 
-// Use ATECCx08 to generate SHA256 digest. Data must be less than 62 characters long
-// for this to work at present. Only handles 1 lot of data.
+/** SHA-256 of a message of any length on the device, see EccSha256.
+ * The digest is left in rsp.
+ */
 uint8_t AtEccX08::calculateSHA256( uint8_t *data, int len )
 {
-    volatile uint8_t ret_code;
-    uint8_t *hash = &this->temp[ECCX08_BUFFER_POS_DATA];
+    EccSha256 sha(*this);
 
-    // For now, just limit input size to 62 chars
-    if( len > 62 ) {
-      return ECCX08_INVALID_SIZE;
-    }
+    if (len < 0)
+      return ECCX08_BAD_PARAM;
 
     this->rsp.clear();
-    this->wakeup();
 
-    // Start SHA256
-    ret_code = eccX08m_execute(ECCX08_SHA, SHA_MODE_START, 0x0000,
-        0, NULL, 0, NULL, 0, NULL,
-        sizeof(this->command), this->command,
-        sizeof(this->temp), this->temp);
+    sha.begin();
+    sha.update(data, len);
 
+    uint8_t ret_code = sha.final(NULL);
     if (ret_code == ECCX08_SUCCESS)
-    {
-        // Send data
-        this->wakeup();
-/*
-        ret_code = eccX08m_execute(ECCX08_SHA, SHA_MODE_UPDATE, len,
-          //0,NULL,
-                    len, data, 
-          0, NULL, 0, NULL,
-                    sizeof(this->command), this->command,
-                    sizeof(this->temp),this->temp);
-        Serial.print(F("SHA256 Update "));
-        Serial.println(ret_code, HEX);
-*/
-    ret_code = eccX08m_execute(ECCX08_SHA, SHA_MODE_END, len, 
-        len, data, //0, NULL, 
-        0, NULL, 0, NULL,
-        sizeof(this->command), this->command,
-        sizeof(this->temp), this->temp);
+      this->rsp.copyBufferFrom(&this->temp[ECCX08_BUFFER_POS_DATA], 32);
 
-//        Serial.print(F("SHA256 End "));
-//        Serial.println(ret_code, HEX);
+    return ret_code;
+}
 
-        this->rsp.copyBufferFrom(hash, 32);
-    }
+/** HMAC-SHA256 of a message of any length with the 32 byte key in a slot,
+ * in one session on the SHA engine (see EccSha256).
+ *
+ * \param[in] slot slot of the key
+ * \param[in] data the message
+ * \param[in] len its length
+ * \return status of the operation, the HMAC is in rsp
+ */
+uint8_t AtEccX08::hmac(uint8_t slot, const uint8_t *data, size_t len)
+{
+  EccSha256 sha(*this);
+
+  this->rsp.clear();
+
+  sha.beginHmac(slot);
+  sha.update(data, len);
+
+  uint8_t ret_code = sha.final(NULL);
+  if (ECCX08_SUCCESS == ret_code)
+    this->rsp.copyBufferFrom(&this->temp[ECCX08_BUFFER_POS_DATA], 32);
+
+  return ret_code;
+}
+
+/** MAC command: SHA-256 of the key in a slot and a 32 byte challenge, for
+ * challenge-response with any slot.
+ *
+ * \param[in] slot slot of the key
+ * \param[in] challenge 32 bytes
+ * \return status of the operation, the digest is in rsp
+ */
+uint8_t AtEccX08::mac(uint8_t slot, const uint8_t *challenge)
+{
+  this->rsp.clear();
+
+  if (NULL == challenge)
+    return ECCX08_BAD_PARAM;
 
+  uint8_t ret_code = this->beginFlow(MAC_EXEC_MAX);
 
-    this->idle();
+  if (ECCX08_SUCCESS != ret_code)
     return ret_code;
+
+  ret_code = this->execute(ecc_mac(MAC_MODE_CHALLENGE, slot,
+                                   MAC_CHALLENGE_SIZE),
+                           const_cast<uint8_t *>(challenge));
+
+  if (ECCX08_SUCCESS == ret_code)
+    this->rsp.copyBufferFrom(&this->temp[ECCX08_BUFFER_POS_DATA],
+                             MAC_CHALLENGE_SIZE);
+
+  this->idle();
+  return ret_code;
 }
 
 
 
 
+/** Execute a command script from flash within a single wake/idle cycle.
+ *
+ * \param[in] script table of steps in PROGMEM
+ * \param[in] steps number of steps in script
+ * \param[in] inputs data blocks referenced by SCRIPT_INPUT(n)
+ * \param[in] outputs buffers referenced by SCRIPT_OUTPUT(n) and by the out
+ *                    field of a step, may be NULL. A missing buffer is
+ *                    not copied to
+ * \param[in] args key slots referenced by steps flagged SCRIPT_PARAM2_ARG
+ * \return status of the first failing step, or ECCX08_SUCCESS. The response
+ *         of the last executed step is left in the receive buffer.
+ *         ECCX08_BAD_PARAM before anything is sent if a data block of a
+ *         step refers to a missing input or output, or an argument is not
+ *         a key slot.
+ */
+uint8_t AtEccX08::runScript(const CommandStep *script, uint8_t steps,
+                            const uint8_t * const *inputs,
+                            uint8_t * const *outputs,
+                            const uint16_t *args)
+{
+  CommandStep step;
+  uint16_t param2;
+  uint16_t worst_ms = 0;
+
+  for (uint8_t i = 0; i < steps; i++)
+    {
+      memcpy_P(&step, &script[i], sizeof(step));
+      worst_ms += command_time(step.op_code, step.param1);
+
+      // The driver does not check for missing data blocks.
+      if ((step.data1_len && !script_data(step.data1, inputs, outputs))
+          || (step.data2_len && !script_data(step.data2, inputs, outputs)))
+        return ECCX08_BAD_PARAM;
+
+      // Arguments are key slots, the table only checked a placeholder.
+      if ((step.flags & SCRIPT_PARAM2_ARG)
+          && (!args || !ecc_valid_slot(args[step.param2])))
+        return ECCX08_BAD_PARAM;
+    }
+
+  uint8_t ret_code = this->beginFlow(worst_ms);
+  if (ret_code != ECCX08_SUCCESS)
+    return ret_code;
+
+  for (uint8_t i = 0; i < steps && ECCX08_SUCCESS == ret_code; i++)
+    {
+      memcpy_P(&step, &script[i], sizeof(step));
+
+      param2 = (step.flags & SCRIPT_PARAM2_ARG) ? args[step.param2] : step.param2;
+
+      ret_code = eccX08m_execute(step.op_code, step.param1, param2,
+                                 step.data1_len,
+                                 script_data(step.data1, inputs, outputs),
+                                 step.data2_len,
+                                 script_data(step.data2, inputs, outputs),
+                                 0, NULL,
+                                 sizeof(this->command), this->command,
+                                 sizeof(this->temp), this->temp);
+      this->commandDone(ret_code);
+
+      if (ECCX08_SUCCESS == ret_code && SCRIPT_NONE != step.out
+          && outputs && outputs[step.out])
+        {
+          memcpy(outputs[step.out] + step.out_offset,
+                 &this->temp[ECCX08_BUFFER_POS_DATA], step.out_len);
+        }
+    }
+
+  this->idle();
+
+  return ret_code;
+}
+
+
+
 // End
\ No newline at end of file
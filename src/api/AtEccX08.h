@@ -21,50 +21,240 @@
 #define LIB_ATECCX08_H_
 
 #include "AtSha204.h"
+#include "CommandScript.h"
+#include "EccCommand.h"
+#include "Hkdf.h"
+#include "ImageSource.h"
+#include "PublicKeyCache.h"
+#include "ResponseView.h"
+#include "Sha256Hash.h"
 #include "../ateccX08-atmel/eccX08_physical.h"
 
+extern "C" {
+#include "../atsha204-atmel/sha204_helper.h"
+}
+
+/* The device resets itself this long after a wake-up and loses TempKey.
+   Sessions keep each flow inside the budget by going through idle, which
+   keeps TempKey, and waking again before the watchdog fires. */
+#ifndef ECCX08_WATCHDOG_MS
+#define ECCX08_WATCHDOG_MS 1300
+#endif
+
+#ifndef ECCX08_WATCHDOG_MARGIN_MS
+#define ECCX08_WATCHDOG_MARGIN_MS 200
+#endif
+
+#define ECCX08_WATCHDOG_BUDGET_MS (ECCX08_WATCHDOG_MS - ECCX08_WATCHDOG_MARGIN_MS)
+
+/* sign() updates the RNG seed in EEPROM before one in this many
+   signatures, 0 leaves it to refreshSeed(). See setSeedInterval(). */
+#ifndef ECCX08_SEED_INTERVAL
+#define ECCX08_SEED_INTERVAL 1
+#endif
+
+/* Random commands run to top up the random pool when randomBytes() finds
+   it empty. See enableRandomPool(). */
+#ifndef ECCX08_RANDOM_POOL_REFILL
+#define ECCX08_RANDOM_POOL_REFILL 1
+#endif
+
+/* What provision() writes. Bit n of a word mask stands for bytes 4n to
+   4n+3 of the zone, writes counts the Write commands that takes: a block
+   in which all eight words differ goes as one 32 byte Write. */
+struct ProvisionPlan
+{
+  uint32_t config_words;
+  uint16_t otp_words;
+  uint8_t writes;
+  bool lock_config;
+  bool lock_data;
+};
+
+struct EncryptedAccess;
+
 class AtEccX08 : public AtSha204
 {
 public:
   AtEccX08();
   ~AtEccX08();
 
+  /* Keeps the device awake for its lifetime, so a number of calls share
+     one wake-up. wakeup() and idle() of the methods called meanwhile do
+     nothing. Sessions nest, the outermost one idles the device when it
+     goes out of scope, or puts it to sleep if asked to.
+
+       {
+         AtEccX08::Session session(ecc);
+         ecc.getRandom();
+         ecc.sign(0, digest, 32);
+       }
+  */
+  class Session
+  {
+  public:
+    explicit Session(AtEccX08 &device, bool sleep = false);
+    ~Session();
+
+    uint8_t status() const;
+
+  private:
+    Session(const Session &);
+    Session &operator=(const Session &);
+
+    AtEccX08 &device;
+    bool sleep;
+    uint8_t wake_status;
+  };
+
+  /* Host work for the next command of this device that goes through
+     execute(), run while the device executes it instead of waiting. The
+     hook must not talk to the device. The hook armed before comes back
+     when this goes out of scope, whether it ran or not.
+
+       {
+         AtEccX08::ExecutionHook hook(ecc, read_next_block, &reader);
+         sha.update(block, 64);
+       }
+  */
+  class ExecutionHook
+  {
+  public:
+    ExecutionHook(AtEccX08 &device, eccX08c_execution_hook_t hook,
+                  void *context);
+    ~ExecutionHook();
+
+  private:
+    ExecutionHook(const ExecutionHook &);
+    ExecutionHook &operator=(const ExecutionHook &);
+
+    AtEccX08 &device;
+    eccX08c_execution_hook_t previous;
+    void *previous_context;
+  };
+
 
   uint8_t wakeup();
   uint8_t getRandom(bool update_seed = false);
+  uint8_t getRandom(RandomBlock &random, bool update_seed = false);
+  void setSeedInterval(uint16_t signatures);
+  bool seedUpdateDue() const;
+  uint8_t refreshSeed();
+  void enableRandomPool(uint8_t *buffer, uint16_t size);
+  uint16_t randomAvailable() const;
+  uint8_t randomBytes(uint8_t *dst, uint16_t n);
+  uint8_t refillRandomPool();
   uint8_t personalize(const uint8_t * config_zone_data, uint8_t config_len,
                       const uint8_t * otp_zone_data, uint8_t optlen);
+  uint8_t personalize_P(const uint8_t * config_zone_data, uint8_t config_len,
+                        const uint8_t * otp_zone_data, uint8_t otp_len);
+  uint8_t provision(const uint8_t * config_zone_data, uint8_t config_len,
+                    const uint8_t * otp_zone_data, uint8_t otp_len,
+                    ProvisionPlan *plan = NULL, bool dry_run = false);
+  uint8_t provision(const ImageSource &config, const ImageSource &otp,
+                    ProvisionPlan *plan = NULL, bool dry_run = false);
   bool is_locked(const uint8_t ZONE);
   void burn_otp();
   uint8_t lock_data_zone();
   uint8_t lockKeySlot( uint8_t slotNum );
   uint8_t sign(uint8_t key, uint8_t *data, int len_32);
+  uint8_t sign(uint8_t key, uint8_t *data, int len_32, Signature &signature);
+  uint8_t signBatch(uint8_t key, const uint8_t digests[][32], uint8_t n,
+                    uint8_t signatures[][64], uint8_t *status = NULL);
   uint8_t verify(uint8_t *data, int len_32,
                  uint8_t *pub_key,
                  uint8_t *signature);
+  uint8_t pinPublicKey(uint8_t slot, const uint8_t *pub_key);
+  uint8_t verifyStored(uint8_t slot, const uint8_t *digest,
+                       const uint8_t *signature);
+  uint8_t verifyBatch(uint8_t slot, const uint8_t digests[][32], uint8_t n,
+                      const uint8_t signatures[][64], uint8_t *status = NULL);
+  uint8_t ecdh(uint8_t slot, const uint8_t *peer_pub_key,
+               uint8_t *shared_secret);
+  uint8_t deriveSessionKey(uint8_t slot, const uint8_t *peer_pub_key,
+                           const uint8_t *salt, uint8_t salt_len,
+                           const uint8_t *info, uint8_t info_len,
+                           uint8_t *key, uint8_t key_len);
   uint8_t hash_verify(const uint8_t *data, int len,
                  uint8_t *pub_key,
                  uint8_t *signature);
+  uint8_t verifyImage(ImageReader reader, void *context, uint32_t len,
+                      uint8_t *pub_key, uint8_t *signature);
+  void setHashCost(Sha256Backend backend, uint16_t fixed_us,
+                   uint16_t block_us);
 //  uint8_t getPubKey(const uint8_t KEY_ID);
 //  uint8_t genPrivateKey(const uint8_t KEY_ID);
   uint8_t genEccKey(const uint8_t KEY_ID, bool privateKey);
+  uint8_t genEccKey(const uint8_t KEY_ID, bool privateKey, PublicKey &pub_key);
+  void enableKeyCache(uint16_t eeprom_address, uint8_t entries);
   uint8_t getSerialNumber(void);
+  uint8_t getSerialNumber(SerialNumber &serial);
   uint8_t getInfo(uint8_t info, uint16_t key_id);
   uint8_t getKeySlotConfig(void);
+  uint8_t getSlotConfig(uint8_t slot, uint16_t &slot_config);
+  uint8_t getKeyConfig(uint8_t slot, uint16_t &key_config);
+  uint8_t getSlotLocked(uint16_t &slot_locked);
+  void invalidateConfig();
+  uint8_t counterRead(uint8_t counter, uint32_t &value);
+  uint8_t counterIncrement(uint8_t counter, uint32_t n = 1,
+                           uint32_t *value = NULL);
+  void invalidateCounters();
   uint8_t calculateSHA256( uint8_t *data, int len);   //, uint8_t *outBuf );
+  uint8_t hmac(uint8_t slot, const uint8_t *data, size_t len);
+  uint8_t mac(uint8_t slot, const uint8_t *challenge);
+  uint8_t readZone(uint8_t zone, uint8_t slot, uint16_t offset, uint16_t len,
+                   uint8_t *dst);
+  uint8_t writeZone(uint8_t zone, uint8_t slot, uint16_t offset, uint16_t len,
+                    const uint8_t *src);
+  uint8_t readEncrypted(uint8_t slot, uint8_t block, uint8_t key_id,
+                        const uint8_t *key, uint8_t *dst);
+  uint8_t writeEncrypted(uint8_t slot, uint8_t block, uint8_t key_id,
+                         const uint8_t *key, const uint8_t *src);
+  uint8_t beginFlow(uint16_t worst_ms);
+  uint8_t runScript(const CommandStep *script, uint8_t steps,
+                    const uint8_t * const *inputs, uint8_t * const *outputs,
+                    const uint16_t *args);
 
 
 protected:
+  friend class EccSha256;
+
   const uint8_t ADDRESS;
   const uint8_t getAddress() const;
   const uint8_t write(uint8_t zone, uint16_t address, uint8_t *new_value,
                       uint8_t *mac, uint8_t size);
   void idle();
-  void burn_config(const uint8_t * data,uint8_t datalen);
-  void burn_otp(const uint8_t * data,uint8_t datalen);
+  uint8_t commandDone(uint8_t ret_code);
+  uint8_t wakeDevice();
+  uint8_t beginSession();
+  void endSession(bool sleep);
+  uint8_t executeFrame(const EccFrame *frame, uint8_t *rx_buffer = NULL,
+                       uint8_t rx_size = 0);
+  uint8_t randomBlock(uint8_t *rx_buffer);
+  uint8_t randomCommand(bool update_seed);
+  uint8_t signCommand(uint8_t key, uint8_t *data, int len_32);
+  uint8_t genKeyCommand(uint8_t KEY_ID, bool privateKey);
+  uint8_t loadSerialNumber();
+  uint8_t counterCommand(uint8_t counter, bool increment);
+  uint8_t beginEncrypted(EncryptedAccess &access, uint16_t worst_ms);
+  uint16_t takeRandom(uint8_t *dst, uint16_t n);
+  void putRandom(const uint8_t *src, uint16_t n);
+  void topUpRandomPool();
+  uint8_t execute(const EccParams &cmd, uint8_t *data1 = NULL,
+                  uint8_t *data2 = NULL);
+  uint8_t verifyResult(uint8_t ret_code);
+  uint8_t burn_config(const uint8_t * data,uint8_t datalen);
+  uint8_t burn_otp(const uint8_t * data,uint8_t datalen);
+  uint8_t config_image_crc(const ImageSource &image, uint16_t &crc);
+  uint8_t diff_words(uint8_t zone, const ImageSource &image,
+                     uint8_t image_offset, uint32_t &words);
+  uint8_t burn_words(uint8_t zone, uint32_t words, const ImageSource &image,
+                     uint8_t image_offset);
 
   uint8_t lock_config_zone();
+  uint8_t lock_config_zone(uint16_t crc);
   uint8_t read_config_zone(uint8_t *config_data);
+  uint8_t loadConfig(bool lock_bytes);
   int load_nonce(uint8_t *to_load, int len);
   int sign_tempkey(const uint8_t KEY_ID);
   uint8_t verify_tempkey( //const uint8_t KEY_ID,
@@ -73,6 +263,43 @@ protected:
 
   bool always_idle = true;
   bool always_wakeup = true;
+  uint8_t session_depth = 0;
+  bool awake = false;
+  unsigned long wake_time = 0;
+  uint16_t seed_interval = ECCX08_SEED_INTERVAL;
+  uint16_t signs_left = 0;
+
+  /* Ring buffer of random bytes owned by the caller, pool_count bytes
+     from pool_head on are unused. */
+  uint8_t *pool = NULL;
+  uint16_t pool_size = 0;
+  uint16_t pool_head = 0;
+  uint16_t pool_count = 0;
+
+  /* Copy of the configuration zone. Once the zone is locked only bytes
+     84-89 (UserExtra, Selector, the lock bytes and SlotLocked) can still
+     change, so only those are dropped by our own lock commands. */
+  uint8_t config_cache[ECCX08_CONFIG_SIZE];
+  uint8_t config_state = 0;
+
+  /* Last value seen of each monotonic counter, valid while its bit in
+     counter_state is set. */
+  uint32_t counter_cache[2];
+  uint8_t counter_state = 0;
+
+  PublicKeyCache key_cache;
+
+  // Armed by ExecutionHook, taken by the next execute().
+  eccX08c_execution_hook_t hook = NULL;
+  void *hook_context = NULL;
+
+  /* Host copy of TempKey, valid while it is known to match the device:
+     Nonce and GenDig of an encrypted access set it, Read leaves it, any
+     other command or a wake-up drops it. */
+  struct sha204h_temp_key temp_key;
+
+  // Picks the SHA-256 backend of hash_verify() and verifyImage().
+  Sha256Costs hash_costs;
 
   void disableIdleWake();
   void enableIdleWake();
@@ -65,6 +65,7 @@ uint8_t AtSha204::macBasic(uint8_t *to_mac, int len)
 {
   uint16_t key_id = 0;
   uint8_t mode = MAC_MODE_CHALLENGE;
+  uint8_t command[MAC_COUNT_LONG];
   uint8_t rc;
 
   if (MAC_CHALLENGE_SIZE != len)
@@ -73,7 +74,7 @@ uint8_t AtSha204::macBasic(uint8_t *to_mac, int len)
   sha204p_wakeup();
 
   if (SHA204_SUCCESS ==
-      (rc = sha204m_mac(this->command, this->temp, mode, key_id, to_mac)))
+      (rc = sha204m_mac(command, this->temp, mode, key_id, to_mac)))
     {
       this->rsp.copyBufferFrom(&this->temp[SHA204_BUFFER_POS_DATA], 32);
     }
@@ -88,6 +89,7 @@ uint8_t AtSha204::checkMacBasic(uint8_t *to_mac, int len, uint8_t *rsp)
   uint16_t key_id = 0;
   uint8_t mode = MAC_MODE_CHALLENGE;
   uint8_t other_data[13] = {0};
+  uint8_t command[CHECKMAC_COUNT];
   uint8_t rc;
 
   if (MAC_CHALLENGE_SIZE != len)
@@ -96,7 +98,7 @@ uint8_t AtSha204::checkMacBasic(uint8_t *to_mac, int len, uint8_t *rsp)
   other_data[0] = 0x08;
   sha204p_wakeup();
 
-  rc = sha204m_check_mac(this->command, this->temp,
+  rc = sha204m_check_mac(command, this->temp,
                          mode, key_id, to_mac, rsp, other_data);
 
   sha204p_idle();
@@ -41,7 +41,9 @@ public:
 
 
 protected:
-  uint8_t command[ECCX08_CMD_SIZE_MAX];
+  // Data blocks are sent straight from the caller's buffers, so only the
+  // packet header and CRC live here.
+  uint8_t command[ECCX08_CMD_SIZE_MIN];
   uint8_t temp[ECCX08_RSP_SIZE_MAX];
   Stream *debugStream = NULL;
   uint8_t checkResponseStatus(uint8_t ret_code, uint8_t *response) const;
@@ -0,0 +1,86 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_COMMANDSCRIPT_H_
+#define LIB_COMMANDSCRIPT_H_
+
+#include <Arduino.h>
+#include "EccCommand.h"
+
+/* A command script is a fixed sequence of device commands kept in flash.
+ * AtEccX08::runScript() executes all steps of a script within a single
+ * wake/idle cycle and stops at the first step that fails.
+ *
+ * Data blocks of a step refer to the caller's tables instead of holding
+ * the data themselves:
+ *   SCRIPT_INPUT(n)  - inputs[n]
+ *   SCRIPT_OUTPUT(n) - outputs[n], e.g. the result of an earlier step
+ *   SCRIPT_NONE      - no data block
+ * The response data of a step is copied to outputs[out] + out_offset.
+ *
+ * Steps are made from the checked commands of EccCommand.h, which also
+ * give the data lengths. Declare the tables constexpr so a step that
+ * fails its checks does not compile. With SCRIPT_PARAM2_ARG the slot is
+ * taken from args[] when the script runs and checked then.
+ */
+#define SCRIPT_NONE           ((uint8_t) 0xFF)
+#define SCRIPT_OUTPUT_FLAG    ((uint8_t) 0x80)
+#define SCRIPT_INPUT(n)       ((uint8_t) (n))
+#define SCRIPT_OUTPUT(n)      ((uint8_t) (SCRIPT_OUTPUT_FLAG | (n)))
+
+/* Step flags */
+#define SCRIPT_PARAM2_ARG     ((uint8_t) 0x01) //!< param2 is an index into args[]
+
+struct CommandStep
+{
+  uint8_t op_code;
+  uint8_t param1;
+  uint16_t param2;
+  uint8_t flags;
+  uint8_t data1;
+  uint8_t data1_len;
+  uint8_t data2;
+  uint8_t data2_len;
+  uint8_t out;
+  uint8_t out_offset;
+  uint8_t out_len;
+};
+
+constexpr CommandStep script_step(EccParams cmd, uint8_t flags, uint8_t d1,
+                                  uint8_t d2, uint8_t out, uint8_t out_offset,
+                                  uint8_t out_len)
+{
+  return CommandStep { cmd.op_code, cmd.param1, cmd.param2, flags,
+      d1, cmd.data1_len, d2, cmd.data2_len, out, out_offset, out_len };
+}
+
+/* Helpers to keep script tables readable. */
+#define SCRIPT_STEP(cmd)                                                \
+  script_step((cmd), 0, SCRIPT_NONE, SCRIPT_NONE, SCRIPT_NONE, 0, 0)
+
+#define SCRIPT_STEP_IN(cmd, flags, d1, d2)                              \
+  script_step((cmd), (flags), (d1), (d2), SCRIPT_NONE, 0, 0)
+
+#define SCRIPT_STEP_OUT(cmd, out, out_offset, out_len)                  \
+  script_step((cmd), 0, SCRIPT_NONE, SCRIPT_NONE, (out), (out_offset),  \
+              (out_len))
+
+#define SCRIPT_LENGTH(script) ((uint8_t) (sizeof(script) / sizeof(CommandStep)))
+
+#endif
@@ -57,6 +57,16 @@ void CryptoBuffer::copyBufferFrom(uint8_t *src, int len)
         }
 }
 
+int CryptoBuffer::copyTo(uint8_t *dst, int max_len)
+{
+    int n = this->len < max_len ? this->len : max_len;
+
+    if (n > 0)
+        memcpy (dst, this->buf, n);
+
+    return n;
+}
+
 const void CryptoBuffer::dumpHex(Stream* stream)
 {
   char temp[3] = {};
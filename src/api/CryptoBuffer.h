@@ -22,6 +22,9 @@
 
 #include <Arduino.h>
 #include "../ateccX08-atmel/eccX08_physical.h"
+/* A copy of the last response of a device. It stays put until the next
+   call that returns data into it; the ResponseView overloads leave it
+   alone and point into the receive buffer instead. */
 class CryptoBuffer
 {
 public:
@@ -32,6 +35,7 @@ public:
   const int getMaxBufferSize();
   const int getLength();
   void copyBufferFrom(uint8_t *src, int len);
+  int copyTo(uint8_t *dst, int max_len);
   const void dumpHex(Stream* stream);
   void clear();
 
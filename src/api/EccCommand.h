@@ -0,0 +1,269 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_ECCCOMMAND_H_
+#define LIB_ECCCOMMAND_H_
+
+#include <Arduino.h>
+#include "../ateccX08-atmel/eccX08_comm_marshaling.h"
+
+/* Commands without data blocks are the same bytes on every call. These
+   helpers build such a packet, CRC included, at compile time so it can be
+   kept in flash and handed to the transport as is:
+
+     static constexpr EccFrame FRAME PROGMEM =
+       ecc_frame(ECCX08_RANDOM, RANDOM_NO_SEED_UPDATE, 0x0000);
+
+   The CRC is the one of eccX08c_calculate_crc(), polynomial 0x8005, bits
+   taken LSB first. */
+
+struct EccFrame
+{
+  uint8_t bytes[ECCX08_CMD_SIZE_MIN];
+};
+
+constexpr uint16_t ecc_crc_bit(uint16_t crc, uint8_t data, uint8_t bit)
+{
+  return bit == 8 ? crc
+    : ecc_crc_bit(((data >> bit) & 1) != (crc >> 15)
+                  ? (uint16_t) ((crc << 1) ^ 0x8005)
+                  : (uint16_t) (crc << 1),
+                  data, bit + 1);
+}
+
+constexpr uint16_t ecc_crc_byte(uint16_t crc, uint8_t data)
+{
+  return ecc_crc_bit(crc, data, 0);
+}
+
+constexpr uint16_t ecc_frame_crc(uint8_t op_code, uint8_t param1,
+                                 uint16_t param2)
+{
+  return ecc_crc_byte(ecc_crc_byte(ecc_crc_byte(ecc_crc_byte(ecc_crc_byte(
+           0, ECCX08_CMD_SIZE_MIN), op_code), param1),
+           (uint8_t) (param2 & 0xFF)), (uint8_t) (param2 >> 8));
+}
+
+constexpr EccFrame ecc_frame(uint8_t op_code, uint8_t param1, uint16_t param2)
+{
+  return EccFrame { { ECCX08_CMD_SIZE_MIN, op_code, param1,
+        (uint8_t) (param2 & 0xFF), (uint8_t) (param2 >> 8),
+        (uint8_t) (ecc_frame_crc(op_code, param1, param2) & 0xFF),
+        (uint8_t) (ecc_frame_crc(op_code, param1, param2) >> 8) } };
+}
+
+/* Checked commands. Each builder validates its mode, slot and data lengths
+   and returns the parameters for eccX08m_execute(). A bad value only fails
+   to compile where the result has to be a constant: a constexpr variable,
+   a frame or a script step in flash. ecc_bad_param() is not constexpr, so
+   the compiler cannot evaluate the failing branch there. Commands with
+   fixed arguments are therefore kept in such constants, e.g.
+
+     static constexpr EccParams SHA_START = ecc_sha(SHA_MODE_START, 0);
+
+   A builder called with run time arguments is checked at run time: a bad
+   value yields a command with op-code ECC_OP_INVALID, which AtEccX08
+   rejects with ECCX08_BAD_PARAM before talking to the device. This
+   replaces the all-or-nothing ECCX08_CHECK_PARAMETERS for the commands
+   built here. */
+
+#define ECC_OP_INVALID ((uint8_t) 0x00)
+
+struct EccParams
+{
+  uint8_t op_code;
+  uint8_t param1;
+  uint16_t param2;
+  uint8_t data1_len;
+  uint8_t data2_len;
+};
+
+inline EccParams ecc_bad_param()
+{
+  return EccParams { ECC_OP_INVALID, 0, 0, 0, 0 };
+}
+
+constexpr EccParams ecc_params(bool ok, uint8_t op_code, uint8_t param1,
+                               uint16_t param2, uint8_t data1_len = 0,
+                               uint8_t data2_len = 0)
+{
+  return ok ? EccParams { op_code, param1, param2, data1_len, data2_len }
+    : ecc_bad_param();
+}
+
+constexpr bool ecc_valid_slot(uint16_t slot)
+{
+  return slot <= ECCX08_KEY_ID_MAX;
+}
+
+constexpr EccParams ecc_random(uint8_t mode)
+{
+  return ecc_params((mode & ~RANDOM_MODE_MASK) == 0,
+                    ECCX08_RANDOM, mode, 0x0000);
+}
+
+constexpr EccParams ecc_info(uint8_t mode, uint16_t param)
+{
+  return ecc_params((mode & ~INFO_MODE_MASK) == 0
+                    && (INFO_MODE_KEY_VALID != mode || ecc_valid_slot(param)),
+                    ECCX08_INFO, mode, param);
+}
+
+/* Config and OTP addresses are word offsets, 32 byte accesses have to start
+   on a block. Data zone addresses are encoded per slot and not checked. */
+constexpr EccParams ecc_read(uint8_t zone, uint16_t address)
+{
+  return ecc_params((zone & ~(ECCX08_ZONE_MASK | ECCX08_ZONE_COUNT_FLAG)) == 0
+                    && (zone & ECCX08_ZONE_MASK) <= ECCX08_ZONE_DATA
+                    && ((zone & ECCX08_ZONE_MASK) == ECCX08_ZONE_DATA
+                        || address < (((zone & ECCX08_ZONE_MASK)
+                                       == ECCX08_ZONE_CONFIG) ? 0x20 : 0x10))
+                    && (!(zone & ECCX08_ZONE_COUNT_FLAG) || (address & 0x07) == 0),
+                    ECCX08_READ, zone, address);
+}
+
+// Plain 4 or 32 byte Write, encrypted writes are not covered.
+constexpr EccParams ecc_write(uint8_t zone, uint16_t address, uint8_t len)
+{
+  return ecc_params((zone & ~(ECCX08_ZONE_MASK | ECCX08_ZONE_COUNT_FLAG)) == 0
+                    && (zone & ECCX08_ZONE_MASK) <= ECCX08_ZONE_DATA
+                    && len == ((zone & ECCX08_ZONE_COUNT_FLAG)
+                               ? ECCX08_ZONE_ACCESS_32 : ECCX08_ZONE_ACCESS_4),
+                    ECCX08_WRITE, zone, address, len);
+}
+
+/* Encrypted 32 byte Write to the data zone, the data goes with its input
+   MAC. Bit 6 of the zone marks the data as encrypted with TempKey. */
+#define ECC_WRITE_ENCRYPTED ((uint8_t) 0x40)
+
+constexpr EccParams ecc_write_encrypted(uint16_t address)
+{
+  return ecc_params(true, ECCX08_WRITE,
+                    ECCX08_ZONE_DATA | ECCX08_ZONE_COUNT_FLAG
+                    | ECC_WRITE_ENCRYPTED,
+                    address, ECCX08_ZONE_ACCESS_32, WRITE_MAC_SIZE);
+}
+
+// GenDig with a stored value, no other data.
+constexpr EccParams ecc_gendig(uint8_t zone, uint16_t key_id)
+{
+  return ecc_params(zone <= GENDIG_ZONE_DATA
+                    && (GENDIG_ZONE_DATA != zone || ecc_valid_slot(key_id)),
+                    ECCX08_GENDIG, zone, key_id);
+}
+
+constexpr EccParams ecc_nonce(uint8_t mode, uint8_t numin_len)
+{
+  return ecc_params((mode & ~NONCE_MODE_MASK) == 0 && mode != 0x02
+                    && numin_len == (NONCE_MODE_PASSTHROUGH == mode
+                                     ? NONCE_NUMIN_SIZE_PASSTHROUGH
+                                     : NONCE_NUMIN_SIZE),
+                    ECCX08_NONCE, mode, NONCE_ZERO_RANDOM_OUT, numin_len);
+}
+
+constexpr EccParams ecc_genkey(uint8_t mode, uint16_t slot)
+{
+  return ecc_params((mode & ~GENKEY_MODE_MASK) == 0 && ecc_valid_slot(slot),
+                    ECCX08_GENKEY, mode, slot);
+}
+
+constexpr EccParams ecc_sign(uint8_t mode, uint16_t slot)
+{
+  return ecc_params((mode & ~SIGN_MODE_MASK) == 0 && ecc_valid_slot(slot),
+                    ECCX08_SIGN, mode, slot);
+}
+
+// External verify of a P256 signature against a public key.
+constexpr EccParams ecc_verify_external(uint8_t signature_len, uint8_t key_len)
+{
+  return ecc_params(VERIFY_256_SIGNATURE_SIZE == signature_len
+                    && VERIFY_256_KEY_SIZE == key_len,
+                    ECCX08_VERIFY, VERIFY_MODE_EXTERNAL, VERIFY_KEY_P256,
+                    signature_len, key_len);
+}
+
+// Verify of a P256 signature against the public key in a slot.
+constexpr EccParams ecc_verify_stored(uint16_t slot, uint8_t signature_len)
+{
+  return ecc_params(ecc_valid_slot(slot)
+                    && VERIFY_256_SIGNATURE_SIZE == signature_len,
+                    ECCX08_VERIFY, VERIFY_MODE_STORED, slot, signature_len);
+}
+
+// Read or increment monotonic counter 0 or 1.
+constexpr EccParams ecc_counter(uint8_t mode, uint16_t counter)
+{
+  return ecc_params((mode & ~COUNTER_MODE_MASK) == 0 && counter <= 1,
+                    ECCX08_COUNTER, mode, counter);
+}
+
+// ECDH with the private key in a slot and the peer's P256 public key.
+constexpr EccParams ecc_ecdh(uint16_t slot, uint8_t key_len)
+{
+  return ecc_params(ecc_valid_slot(slot) && ECDH_PUB_KEY_SIZE == key_len,
+                    ECCX08_ECDH, 0x00, slot, key_len);
+}
+
+// Start, a 64 byte Update, or (HMAC) End with the last 0 to 63 bytes.
+constexpr EccParams ecc_sha(uint8_t mode, uint8_t len)
+{
+  return ecc_params((SHA_MODE_START == mode && 0 == len)
+                    || (SHA_MODE_UPDATE == mode && 64 == len)
+                    || ((SHA_MODE_END == mode || SHA_MODE_HMAC_END == mode)
+                        && len < 64),
+                    ECCX08_SHA, mode, len, len);
+}
+
+// HMAC Start, keyed with the 32 bytes in a slot.
+constexpr EccParams ecc_sha_hmac_start(uint16_t slot)
+{
+  return ecc_params(ecc_valid_slot(slot), ECCX08_SHA, SHA_MODE_HMAC_START,
+                    slot);
+}
+
+// MAC of a 32 byte challenge, or of TempKey if the mode takes it.
+constexpr EccParams ecc_mac(uint8_t mode, uint16_t slot, uint8_t challenge_len)
+{
+  return ecc_params((mode & ~MAC_MODE_MASK) == 0 && ecc_valid_slot(slot)
+                    && challenge_len == ((mode & MAC_MODE_BLOCK2_TEMPKEY)
+                                         ? 0 : MAC_CHALLENGE_SIZE),
+                    ECCX08_MAC, mode, slot, challenge_len);
+}
+
+// A zero count, rejected by eccX08m_execute_frame().
+inline EccFrame ecc_bad_frame()
+{
+  return EccFrame { { 0 } };
+}
+
+// Frames are for commands without data only.
+constexpr EccFrame ecc_frame(EccParams cmd)
+{
+  return ECC_OP_INVALID != cmd.op_code && 0 == cmd.data1_len
+    && 0 == cmd.data2_len
+    ? ecc_frame(cmd.op_code, cmd.param1, cmd.param2)
+    : ecc_bad_frame();
+}
+
+// Random with seed update, as sent by the runtime marshaling layer.
+static_assert(ecc_frame(0x1B, 0x00, 0x0000).bytes[5] == 0x24
+              && ecc_frame(0x1B, 0x00, 0x0000).bytes[6] == 0xCD,
+              "compile time CRC does not match eccX08c_calculate_crc");
+
+#endif
@@ -0,0 +1,232 @@
+/* -*- mode: c++; c-file-style: "gnu" -*- Copyright (C) 2014
+ * Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "EccDrbg.h"
+#include "../ateccX08-atmel/eccX08_lib_return_codes.h"
+
+EccDrbg::EccDrbg(AtEccX08 &device)
+  : device(device), reseed_counter(0),
+    reseed_interval(ECC_DRBG_RESEED_INTERVAL), prediction_resistance(false)
+{
+}
+
+EccDrbg::~EccDrbg()
+{
+  this->clear();
+}
+
+/** Instantiate from 32 bytes of device entropy and a 32 byte nonce, also
+ * from the device, replacing any earlier state.
+ *
+ * \param[in] personalization optional string that sets this instance apart
+ * \param[in] len its length
+ * \return status of the Random commands
+ */
+uint8_t EccDrbg::begin(const uint8_t *personalization, uint8_t len)
+{
+  uint8_t seed[2 * HASH_LENGTH];
+
+  this->clear();
+
+  uint8_t ret_code = this->entropy(seed, 2);
+
+  if (ECCX08_SUCCESS == ret_code)
+    {
+      memset(this->key, 0x00, sizeof(this->key));
+      memset(this->v, 0x01, sizeof(this->v));
+      this->update(seed, sizeof(seed), personalization, len);
+      this->reseed_counter = 1;
+    }
+
+  memset(seed, 0, sizeof(seed));
+  return ret_code;
+}
+
+/** Mix 32 bytes of fresh device entropy into the state.
+ *
+ * \param[in] additional optional input mixed in as well
+ * \param[in] len its length
+ * \return status of the Random command
+ */
+uint8_t EccDrbg::reseed(const uint8_t *additional, uint8_t len)
+{
+  if (!this->seeded())
+    return this->begin(additional, len);
+
+  uint8_t seed[HASH_LENGTH];
+  uint8_t ret_code = this->entropy(seed, 1);
+
+  if (ECCX08_SUCCESS == ret_code)
+    {
+      this->update(seed, sizeof(seed), additional, len);
+      this->reseed_counter = 1;
+    }
+
+  memset(seed, 0, sizeof(seed));
+  return ret_code;
+}
+
+/** Fill dst with n pseudo random bytes.
+ *
+ * \param[out] dst where the bytes go
+ * \param[in] n how many, at most ECC_DRBG_MAX_REQUEST
+ * \param[in] additional optional input mixed in before and after
+ * \param[in] len its length
+ * \return status of the (re)seeding if the device was needed, otherwise
+ *         ECCX08_SUCCESS
+ */
+uint8_t EccDrbg::generate(uint8_t *dst, uint16_t n,
+                          const uint8_t *additional, uint8_t len)
+{
+  uint8_t ret_code = ECCX08_SUCCESS;
+
+  if (NULL == dst && 0 != n)
+    return ECCX08_BAD_PARAM;
+
+  if (!this->seeded())
+    ret_code = this->begin();
+  else if (this->prediction_resistance
+           || this->reseed_counter > this->reseed_interval)
+    {
+      // The additional input went into the reseed.
+      ret_code = this->reseed(additional, len);
+      additional = NULL;
+      len = 0;
+    }
+
+  if (ECCX08_SUCCESS != ret_code)
+    return ret_code;
+
+  if (0 != len)
+    this->update(additional, len);
+
+  while (0 != n)
+    {
+      uint8_t chunk = n < HASH_LENGTH ? n : HASH_LENGTH;
+
+      this->hmac.initHmac(this->key, sizeof(this->key));
+      this->hmac.write(this->v, sizeof(this->v));
+      memcpy(this->v, this->hmac.resultHmac(), sizeof(this->v));
+      memcpy(dst, this->v, chunk);
+      dst += chunk;
+      n -= chunk;
+    }
+
+  this->update(additional, len);
+  this->reseed_counter++;
+  return ECCX08_SUCCESS;
+}
+
+/** Reseed from the device after this many generate() calls.
+ *
+ * \param[in] requests requests per seed, 1 reseeds before every one after
+ *            the first
+ */
+void EccDrbg::setReseedInterval(uint32_t requests)
+{
+  this->reseed_interval = 0 == requests ? 1 : requests;
+}
+
+/** Reseed from the device before every generate(), so output can't be
+ * predicted from a state that leaked earlier. Every request then costs a
+ * Random command.
+ */
+void EccDrbg::setPredictionResistance(bool enable)
+{
+  this->prediction_resistance = enable;
+}
+
+bool EccDrbg::seeded() const
+{
+  return 0 != this->reseed_counter;
+}
+
+/* Forget the state, generate() instantiates again. Sha256Class keeps the
+   last key, inner hash and output, so it is left with those of an empty
+   message under the zero key instead; it has a vtable and can't be
+   memset. */
+void EccDrbg::clear()
+{
+  memset(this->key, 0, sizeof(this->key));
+  memset(this->v, 0, sizeof(this->v));
+  this->hmac.initHmac(this->key, sizeof(this->key));
+  this->hmac.resultHmac();
+  this->reseed_counter = 0;
+}
+
+/** Read blocks of 32 bytes from the Random command, all in one session.
+ * A device with an unlocked configuration zone answers with a repeated
+ * FF FF 00 00, which is no entropy at all.
+ */
+uint8_t EccDrbg::entropy(uint8_t *dst, uint8_t blocks)
+{
+  AtEccX08::Session session(this->device);
+  uint8_t ret_code = session.status();
+
+  for (uint8_t b = 0; ECCX08_SUCCESS == ret_code && b < blocks; b++)
+    {
+      RandomBlock block;
+
+      ret_code = this->device.getRandom(block);
+      if (ECCX08_SUCCESS != ret_code)
+        break;
+
+      const uint8_t *random = block.data();
+      bool fixed = true;
+
+      for (uint8_t i = 0; i < HASH_LENGTH; i++)
+        fixed = fixed && random[i] == ((i & 2) ? 0x00 : 0xFF);
+
+      if (fixed)
+        ret_code = ECCX08_FUNC_FAIL;
+      else
+        memcpy(dst + b * HASH_LENGTH, random, HASH_LENGTH);
+    }
+
+  return ret_code;
+}
+
+// V = HMAC(K, V || separator || data1 || data2), with K set beforehand.
+void EccDrbg::updateRound(uint8_t separator, const uint8_t *data1, uint8_t len1,
+                    const uint8_t *data2, uint8_t len2)
+{
+  this->hmac.initHmac(this->key, sizeof(this->key));
+  this->hmac.write(this->v, sizeof(this->v));
+  this->hmac.write(separator);
+  if (0 != len1)
+    this->hmac.write(data1, len1);
+  if (0 != len2)
+    this->hmac.write(data2, len2);
+  memcpy(this->key, this->hmac.resultHmac(), sizeof(this->key));
+
+  this->hmac.initHmac(this->key, sizeof(this->key));
+  this->hmac.write(this->v, sizeof(this->v));
+  memcpy(this->v, this->hmac.resultHmac(), sizeof(this->v));
+}
+
+/** HMAC_DRBG_Update. The provided data is data1 followed by data2, the
+ * second round only runs when there is some.
+ */
+void EccDrbg::update(const uint8_t *data1, uint8_t len1,
+                     const uint8_t *data2, uint8_t len2)
+{
+  this->updateRound(0x00, data1, len1, data2, len2);
+  if (0 != len1 || 0 != len2)
+    this->updateRound(0x01, data1, len1, data2, len2);
+}
@@ -0,0 +1,83 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_ECCDRBG_H_
+#define LIB_ECCDRBG_H_
+
+#include <Arduino.h>
+#include "AtEccX08.h"
+#include "../softcrypto/sha_256.h"
+
+/* Requests generate() serves before it reseeds from the device. SP 800-90A
+   allows up to 2^48, lower values mix in fresh device entropy more often. */
+#ifndef ECC_DRBG_RESEED_INTERVAL
+#define ECC_DRBG_RESEED_INTERVAL 1024
+#endif
+
+// Bytes one generate() call may return, 2^19 bits in SP 800-90A.
+#define ECC_DRBG_MAX_REQUEST 0xFFFF
+
+/* HMAC_DRBG with SHA-256 of SP 800-90A, computed in software with
+   Sha256Class and seeded from Random commands of the device. Only the
+   (re)seeding talks to the device, so the output rate is that of the
+   software HMAC.
+
+     EccDrbg drbg(ecc);
+     drbg.begin();
+     drbg.generate(buffer, sizeof(buffer));
+
+   generate() instantiates on first use and reseeds by itself after
+   setReseedInterval() requests, or before every request with prediction
+   resistance. An unlocked device returns a fixed pattern instead of
+   random numbers, which is refused with ECCX08_FUNC_FAIL. */
+class EccDrbg
+{
+public:
+  explicit EccDrbg(AtEccX08 &device);
+  ~EccDrbg();
+
+  uint8_t begin(const uint8_t *personalization = NULL, uint8_t len = 0);
+  uint8_t reseed(const uint8_t *additional = NULL, uint8_t len = 0);
+  uint8_t generate(uint8_t *dst, uint16_t n,
+                   const uint8_t *additional = NULL, uint8_t len = 0);
+  void setReseedInterval(uint32_t requests);
+  void setPredictionResistance(bool enable);
+  bool seeded() const;
+  void clear();
+
+private:
+  EccDrbg(const EccDrbg &);
+  EccDrbg &operator=(const EccDrbg &);
+
+  uint8_t entropy(uint8_t *dst, uint8_t blocks);
+  void updateRound(uint8_t separator, const uint8_t *data1, uint8_t len1,
+             const uint8_t *data2, uint8_t len2);
+  void update(const uint8_t *data1, uint8_t len1,
+              const uint8_t *data2 = NULL, uint8_t len2 = 0);
+
+  AtEccX08 &device;
+  Sha256Class hmac;
+  uint8_t key[HASH_LENGTH];
+  uint8_t v[HASH_LENGTH];
+  uint32_t reseed_counter;
+  uint32_t reseed_interval;
+  bool prediction_resistance;
+};
+
+#endif
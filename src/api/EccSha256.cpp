@@ -0,0 +1,185 @@
+/* -*- mode: c++; c-file-style: "gnu" -*- Copyright (C) 2014
+ * Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "EccSha256.h"
+#include "../ateccX08-atmel/eccX08_lib_return_codes.h"
+
+static constexpr EccParams SHA_START = ecc_sha(SHA_MODE_START, 0);
+
+EccSha256::EccSha256(AtEccX08 &device)
+  : device(device), used(0), ret_code(ECCX08_BAD_PARAM),
+    end_mode(SHA_MODE_END), open(false)
+{
+}
+
+EccSha256::~EccSha256()
+{
+  this->close();
+}
+
+/** Start a hash, abandoning the one in progress if any.
+ *
+ * \return status of the SHA Start command
+ */
+uint8_t EccSha256::begin()
+{
+  return this->start(SHA_START, SHA_MODE_END);
+}
+
+/** Start an HMAC keyed with the 32 byte key in a slot, abandoning the hash
+ * in progress if any. The key never leaves the device, final() returns
+ * the HMAC.
+ *
+ * \param[in] slot slot of the key
+ * \return status of the SHA HMAC Start command
+ */
+uint8_t EccSha256::beginHmac(uint8_t slot)
+{
+  return this->start(ecc_sha_hmac_start(slot), SHA_MODE_HMAC_END);
+}
+
+/** Add bytes to the message. Whole blocks are sent straight from data.
+ *
+ * \param[in] data message bytes
+ * \param[in] len number of bytes
+ * \return ECCX08_SUCCESS, or the status of the first failure
+ */
+uint8_t EccSha256::update(const uint8_t *data, size_t len)
+{
+  while (this->open && len > 0)
+    {
+      if (0 == this->used && len >= sizeof(this->block))
+        {
+          this->send(SHA_MODE_UPDATE, data, sizeof(this->block));
+          data += sizeof(this->block);
+          len -= sizeof(this->block);
+          continue;
+        }
+
+      uint8_t n = sizeof(this->block) - this->used;
+      if (n > len)
+        n = len;
+
+      memcpy(&this->block[this->used], data, n);
+      this->used += n;
+      data += n;
+      len -= n;
+
+      if (sizeof(this->block) == this->used)
+        {
+          this->send(SHA_MODE_UPDATE, this->block, sizeof(this->block));
+          this->used = 0;
+        }
+    }
+
+  return this->ret_code;
+}
+
+/** Add everything a stream has available to the message.
+ *
+ * \param[in] stream source of the bytes
+ * \return ECCX08_SUCCESS, or the status of the first failure
+ */
+uint8_t EccSha256::update(Stream &stream)
+{
+  int c;
+
+  while (this->open && (c = stream.read()) >= 0)
+    this->write((uint8_t) c);
+
+  return this->ret_code;
+}
+
+/** Finish the hash and leave the session.
+ *
+ * \param[out] digest 32 bytes, or NULL to leave the digest in the response
+ *             buffer of the device object only
+ * \return status of the operation
+ */
+uint8_t EccSha256::final(uint8_t *digest)
+{
+  if (!this->open)
+    return this->ret_code;
+
+  if (ECCX08_SUCCESS == this->send(this->end_mode, this->block, this->used)
+      && digest)
+    memcpy(digest, &this->device.temp[ECCX08_BUFFER_POS_DATA], 32);
+
+  this->close();
+
+  return this->ret_code;
+}
+
+uint8_t EccSha256::status() const
+{
+  return this->ret_code;
+}
+
+size_t EccSha256::write(uint8_t data)
+{
+  return ECCX08_SUCCESS == this->update(&data, 1) ? 1 : 0;
+}
+
+size_t EccSha256::write(const uint8_t *data, size_t len)
+{
+  return ECCX08_SUCCESS == this->update(data, len) ? len : 0;
+}
+
+uint8_t EccSha256::start(const EccParams &cmd, uint8_t end_mode)
+{
+  this->close();
+  this->used = 0;
+  this->end_mode = end_mode;
+
+  this->ret_code = this->device.beginSession();
+  this->open = true;
+
+  if (ECCX08_SUCCESS == this->ret_code)
+    this->send(cmd, NULL);
+  else
+    this->close();
+
+  return this->ret_code;
+}
+
+uint8_t EccSha256::send(uint8_t mode, const uint8_t *data, uint8_t len)
+{
+  return this->send(ecc_sha(mode, len), data);
+}
+
+uint8_t EccSha256::send(const EccParams &cmd, const uint8_t *data)
+{
+  this->ret_code = this->device.beginFlow(SHA_EXEC_MAX);
+
+  if (ECCX08_SUCCESS == this->ret_code)
+    this->ret_code = this->device.execute(cmd, const_cast<uint8_t *>(data));
+
+  if (ECCX08_SUCCESS != this->ret_code)
+    this->close();
+
+  return this->ret_code;
+}
+
+void EccSha256::close()
+{
+  if (this->open)
+    this->device.endSession(false);
+
+  this->open = false;
+}
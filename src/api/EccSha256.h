@@ -0,0 +1,76 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_ECCSHA256_H_
+#define LIB_ECCSHA256_H_
+
+#include <Arduino.h>
+#include "AtEccX08.h"
+
+/* SHA-256 of a message of any length on the SHA engine of the device.
+   The message goes out in 64 byte Update commands as it comes in, only a
+   partial block is kept here. The device stays in a session from begin()
+   to final() and is cycled through idle when the watchdog comes near,
+   which keeps the state of the engine.
+
+     EccSha256 sha(ecc);
+     sha.begin();
+     sha.update(header, sizeof(header));
+     sha.update(file);
+     sha.final(digest);
+
+   beginHmac() does the same for an HMAC with a key kept in a slot.
+
+   It is a Print as well, so anything that can print can be hashed. After
+   a failure the hash is abandoned and every call returns the status. */
+class EccSha256 : public Print
+{
+public:
+  explicit EccSha256(AtEccX08 &device);
+  ~EccSha256();
+
+  uint8_t begin();
+  uint8_t beginHmac(uint8_t slot);
+  uint8_t update(const uint8_t *data, size_t len);
+  uint8_t update(Stream &stream);
+  uint8_t final(uint8_t *digest);
+  uint8_t status() const;
+
+  virtual size_t write(uint8_t data);
+  virtual size_t write(const uint8_t *data, size_t len);
+  using Print::write;
+
+private:
+  EccSha256(const EccSha256 &);
+  EccSha256 &operator=(const EccSha256 &);
+
+  uint8_t start(const EccParams &cmd, uint8_t end_mode);
+  uint8_t send(uint8_t mode, const uint8_t *data, uint8_t len);
+  uint8_t send(const EccParams &cmd, const uint8_t *data);
+  void close();
+
+  AtEccX08 &device;
+  uint8_t block[64];
+  uint8_t used;
+  uint8_t ret_code;
+  uint8_t end_mode;
+  bool open;
+};
+
+#endif
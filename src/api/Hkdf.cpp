@@ -0,0 +1,64 @@
+/* -*- mode: c++; c-file-style: "gnu" -*- Copyright (C) 2014
+ * Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "Hkdf.h"
+#include "../softcrypto/sha_256.h"
+
+void hkdf_sha256(const uint8_t *salt, uint8_t salt_len,
+                 const uint8_t *ikm, uint8_t ikm_len,
+                 const uint8_t *info, uint8_t info_len,
+                 uint8_t *okm, uint8_t okm_len)
+{
+  static const uint8_t zero_salt[HASH_LENGTH] = { 0 };
+  Sha256Class hmac;
+  uint8_t prk[HASH_LENGTH];
+  uint8_t t[HASH_LENGTH];
+
+  if (NULL == salt || 0 == salt_len)
+    {
+      salt = zero_salt;
+      salt_len = sizeof(zero_salt);
+    }
+
+  // Extract
+  hmac.initHmac(salt, salt_len);
+  hmac.write(ikm, ikm_len);
+  memcpy(prk, hmac.resultHmac(), sizeof(prk));
+
+  // Expand, T(i) = HMAC(PRK, T(i - 1) | info | i)
+  for (uint8_t i = 1; 0 != okm_len; i++)
+    {
+      uint8_t chunk = okm_len < HASH_LENGTH ? okm_len : HASH_LENGTH;
+
+      hmac.initHmac(prk, sizeof(prk));
+      if (i > 1)
+        hmac.write(t, sizeof(t));
+      if (0 != info_len)
+        hmac.write(info, info_len);
+      hmac.write(i);
+      memcpy(t, hmac.resultHmac(), sizeof(t));
+
+      memcpy(okm, t, chunk);
+      okm += chunk;
+      okm_len -= chunk;
+    }
+
+  memset(prk, 0, sizeof(prk));
+  memset(t, 0, sizeof(t));
+}
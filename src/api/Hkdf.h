@@ -0,0 +1,32 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_HKDF_H_
+#define LIB_HKDF_H_
+
+#include <Arduino.h>
+
+/* HKDF with HMAC-SHA256 (RFC 5869) on Sha256Class, to turn a shared
+   secret into session keys. A NULL salt is 32 zero bytes. */
+void hkdf_sha256(const uint8_t *salt, uint8_t salt_len,
+                 const uint8_t *ikm, uint8_t ikm_len,
+                 const uint8_t *info, uint8_t info_len,
+                 uint8_t *okm, uint8_t okm_len);
+
+#endif
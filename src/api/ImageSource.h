@@ -0,0 +1,85 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_IMAGESOURCE_H_
+#define LIB_IMAGESOURCE_H_
+
+#include <Arduino.h>
+#include "../ateccX08-atmel/eccX08_lib_return_codes.h"
+
+/* Reads len bytes at offset of an image, e.g. from EEPROM, flash, SD or
+   SPI memory. Returns ECCX08_SUCCESS or an error, which ends the read.
+   Used by ImageSource for provisioning and by verifyImage(). */
+typedef uint8_t (*ImageReader)(void *context, uint32_t offset, uint8_t *dst,
+                               uint8_t len);
+
+/* Where a provisioning image comes from. The image is fetched a block at
+   a time into the buffer the Write is sent from, so it can stay in flash
+   or be produced on the fly instead of taking SRAM:
+
+     static const uint8_t config_zone[] PROGMEM = { ... };
+     ecc.provision(ImageSource::progmem(config_zone, sizeof(config_zone)),
+                   ImageSource(otp_zone, sizeof(otp_zone)));
+
+   A reader is given the offset into the image, never more than 32 bytes
+   at once, and returns ECCX08_SUCCESS or an error. provision() stops at
+   the first error, before anything is written or locked if the error
+   comes while the image is compared. */
+class ImageSource
+{
+public:
+  ImageSource(const uint8_t *ram, uint16_t len)
+    : reader(read_ram), context(const_cast<uint8_t *>(ram)), len(len) { }
+  ImageSource(ImageReader reader, void *context, uint16_t len)
+    : reader(reader), context(context), len(len) { }
+
+  static ImageSource progmem(const uint8_t *flash, uint16_t len)
+  {
+    return ImageSource(read_progmem, const_cast<uint8_t *>(flash), len);
+  }
+
+  uint16_t length() const { return this->len; }
+
+  uint8_t read(uint16_t offset, uint8_t *dst, uint8_t n) const
+  {
+    return this->reader(this->context, offset, dst, n);
+  }
+
+private:
+  // The image is only ever read, the cast in the constructors is safe.
+  static uint8_t read_ram(void *context, uint32_t offset, uint8_t *dst,
+                          uint8_t n)
+  {
+    memcpy(dst, (const uint8_t *) context + offset, n);
+    return ECCX08_SUCCESS;
+  }
+
+  static uint8_t read_progmem(void *context, uint32_t offset, uint8_t *dst,
+                              uint8_t n)
+  {
+    memcpy_P(dst, (const uint8_t *) context + offset, n);
+    return ECCX08_SUCCESS;
+  }
+
+  ImageReader reader;
+  void *context;
+  uint16_t len;
+};
+
+#endif
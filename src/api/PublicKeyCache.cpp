@@ -0,0 +1,166 @@
+/* -*- mode: c++; c-file-style: "gnu" -*- Copyright (C) 2014
+ * Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "PublicKeyCache.h"
+#include <avr/eeprom.h>
+
+#define CACHE_FORMAT      0x4C
+#define CACHE_SLOTS       16
+#define CACHE_SERIAL_SIZE 9
+#define CACHE_KEY_SIZE    64
+#define CACHE_TAG_SIZE    (CACHE_SERIAL_SIZE + 1)
+#define CACHE_ENTRY_SIZE  (CACHE_TAG_SIZE + CACHE_KEY_SIZE)
+#define CACHE_NO_SLOT     0xFF
+
+#define EEPROM_PTR(a) ((uint8_t *) (uintptr_t) (a))
+
+PublicKeyCache::PublicKeyCache()
+  : address(0), entries(0), next(0)
+{
+}
+
+/** Use part of the EEPROM for the cache, formatting it if it doesn't hold
+ * one yet.
+ *
+ * \param[in] address first EEPROM byte, size(entries) bytes are used
+ * \param[in] entries number of keys kept, 0 to disable the cache
+ */
+void PublicKeyCache::begin(uint16_t address, uint8_t entries)
+{
+  this->address = address;
+  this->entries = entries;
+  this->next = 0;
+
+  if (!entries || CACHE_FORMAT == eeprom_read_byte(EEPROM_PTR(address)))
+    return;
+
+  for (uint8_t entry = 0; entry < entries; entry++)
+    eeprom_update_byte(EEPROM_PTR(this->entryAddress(entry)
+                                  + CACHE_SERIAL_SIZE), CACHE_NO_SLOT);
+
+  eeprom_update_byte(EEPROM_PTR(address), CACHE_FORMAT);
+}
+
+bool PublicKeyCache::enabled() const
+{
+  return 0 != this->entries;
+}
+
+/** EEPROM bytes taken by a cache of a number of entries. */
+uint16_t PublicKeyCache::size(uint8_t entries)
+{
+  return 1 + (uint16_t) entries * CACHE_ENTRY_SIZE;
+}
+
+/** Find the public key of a slot of a device.
+ *
+ * \param[in] serial 9 byte serial number of the device
+ * \param[in] slot private key slot
+ * \param[out] pub_key 64 bytes, filled on a hit
+ * \return true on a hit
+ */
+bool PublicKeyCache::lookup(const uint8_t *serial, uint8_t slot,
+                            uint8_t *pub_key) const
+{
+  for (uint8_t entry = 0; entry < this->entries; entry++)
+    if (this->matches(entry, serial, slot))
+      {
+        eeprom_read_block(pub_key, EEPROM_PTR(this->entryAddress(entry)
+                                              + CACHE_TAG_SIZE),
+                          CACHE_KEY_SIZE);
+        return true;
+      }
+
+  return false;
+}
+
+/** Keep the public key of a slot. It replaces the entry the slot already
+ * has, else a free entry, else the oldest one.
+ */
+void PublicKeyCache::store(const uint8_t *serial, uint8_t slot,
+                           const uint8_t *pub_key)
+{
+  uint8_t tag[CACHE_TAG_SIZE];
+  uint8_t entry = 0;
+
+  if (!this->entries || slot >= CACHE_SLOTS)
+    return;
+
+  while (entry < this->entries && !this->matches(entry, serial, slot))
+    entry++;
+
+  if (entry == this->entries)
+    for (entry = 0; entry < this->entries && !this->unused(entry); entry++)
+      ;
+
+  if (entry == this->entries)
+    {
+      entry = this->next;
+      this->next = (this->next + 1) % this->entries;
+    }
+
+  memcpy(tag, serial, CACHE_SERIAL_SIZE);
+  tag[CACHE_SERIAL_SIZE] = slot;
+
+  // Untag the entry first, so a reset halfway leaves no entry that
+  // matches a half written key.
+  eeprom_update_byte(EEPROM_PTR(this->entryAddress(entry) + CACHE_SERIAL_SIZE),
+                     CACHE_NO_SLOT);
+  eeprom_update_block(pub_key, EEPROM_PTR(this->entryAddress(entry)
+                                          + CACHE_TAG_SIZE), CACHE_KEY_SIZE);
+  eeprom_update_block(tag, EEPROM_PTR(this->entryAddress(entry)),
+                      sizeof(tag));
+}
+
+/** Drop the public key of a slot of a device.
+ *
+ * \param[in] serial 9 byte serial number of the device, NULL for the slot
+ *            of every device
+ * \param[in] slot private key slot
+ */
+void PublicKeyCache::invalidate(const uint8_t *serial, uint8_t slot)
+{
+  for (uint8_t entry = 0; entry < this->entries; entry++)
+    if (this->matches(entry, serial, slot))
+      eeprom_update_byte(EEPROM_PTR(this->entryAddress(entry)
+                                    + CACHE_SERIAL_SIZE), CACHE_NO_SLOT);
+}
+
+uint16_t PublicKeyCache::entryAddress(uint8_t entry) const
+{
+  return this->address + 1 + (uint16_t) entry * CACHE_ENTRY_SIZE;
+}
+
+bool PublicKeyCache::unused(uint8_t entry) const
+{
+  return eeprom_read_byte(EEPROM_PTR(this->entryAddress(entry)
+                                     + CACHE_SERIAL_SIZE)) >= CACHE_SLOTS;
+}
+
+// A NULL serial matches any device.
+bool PublicKeyCache::matches(uint8_t entry, const uint8_t *serial,
+                             uint8_t slot) const
+{
+  uint8_t tag[CACHE_TAG_SIZE];
+
+  eeprom_read_block(tag, EEPROM_PTR(this->entryAddress(entry)), sizeof(tag));
+
+  return slot == tag[CACHE_SERIAL_SIZE]
+    && (NULL == serial || 0 == memcmp(tag, serial, CACHE_SERIAL_SIZE));
+}
@@ -0,0 +1,55 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_PUBLICKEYCACHE_H_
+#define LIB_PUBLICKEYCACHE_H_
+
+#include <Arduino.h>
+
+/* Public keys kept in the EEPROM of the MCU, so asking for the public key
+   of a slot does not run GenKey every time. An entry is tagged with the
+   serial number of the device and the slot. Generating a new private key
+   untags the entry of that device and slot.
+
+   Layout from the base address: a format byte, then the entries of 9
+   serial number bytes, slot and the 64 byte key. */
+class PublicKeyCache
+{
+public:
+  PublicKeyCache();
+
+  void begin(uint16_t address, uint8_t entries);
+  bool enabled() const;
+  bool lookup(const uint8_t *serial, uint8_t slot, uint8_t *pub_key) const;
+  void store(const uint8_t *serial, uint8_t slot, const uint8_t *pub_key);
+  void invalidate(const uint8_t *serial, uint8_t slot);
+
+  static uint16_t size(uint8_t entries);
+
+private:
+  uint16_t entryAddress(uint8_t entry) const;
+  bool matches(uint8_t entry, const uint8_t *serial, uint8_t slot) const;
+  bool unused(uint8_t entry) const;
+
+  uint16_t address;
+  uint8_t entries;
+  uint8_t next;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_RESPONSEVIEW_H_
+#define LIB_RESPONSEVIEW_H_
+
+#include <Arduino.h>
+
+/* A fixed size result that points into the receive buffer of the driver.
+   Unlike the copy in rsp it is only good until the next command is sent,
+   so call copyTo() to keep it. A view of a failed command is not valid(). */
+template <uint8_t N>
+class ResponseView
+{
+public:
+  static const uint8_t SIZE = N;
+
+  ResponseView() : ptr(NULL) { }
+  explicit ResponseView(const uint8_t *data) : ptr(data) { }
+
+  const uint8_t *data() const { return this->ptr; }
+  uint8_t size() const { return N; }
+  bool valid() const { return NULL != this->ptr; }
+
+  bool copyTo(uint8_t *dst) const
+  {
+    if (!this->valid())
+      return false;
+
+    memcpy(dst, this->ptr, N);
+    return true;
+  }
+
+protected:
+  const uint8_t *ptr;
+};
+
+// Distinct types so a public key can't be passed where a signature goes.
+
+class Signature : public ResponseView<64>
+{
+public:
+  Signature() { }
+  explicit Signature(const uint8_t *data) : ResponseView<64>(data) { }
+};
+
+class PublicKey : public ResponseView<64>
+{
+public:
+  PublicKey() { }
+  explicit PublicKey(const uint8_t *data) : ResponseView<64>(data) { }
+};
+
+class RandomBlock : public ResponseView<32>
+{
+public:
+  RandomBlock() { }
+  explicit RandomBlock(const uint8_t *data) : ResponseView<32>(data) { }
+};
+
+class SerialNumber : public ResponseView<9>
+{
+public:
+  SerialNumber() { }
+  explicit SerialNumber(const uint8_t *data) : ResponseView<9>(data) { }
+};
+
+#endif
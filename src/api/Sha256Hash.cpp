@@ -0,0 +1,372 @@
+/* -*- mode: c++; c-file-style: "gnu" -*- Copyright (C) 2014
+ * Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "Sha256Hash.h"
+#include "AtEccX08.h"
+#include "EccSha256.h"
+#include "../ateccX08-atmel/eccX08_lib_return_codes.h"
+#include "../softcrypto/sha256.h"
+#include "../softcrypto/sha_256.h"
+
+extern "C" {
+#include "../atsha204-atmel/sha204_helper.h"
+}
+
+// The next block of a stream, read while the device hashes the current one.
+struct StreamRead
+{
+  ImageReader reader;
+  void *context;
+  uint32_t offset;
+  uint8_t *dst;
+  uint8_t len;
+  uint8_t status;
+};
+
+// Readers are not asked for nothing at the end of a stream.
+static uint8_t read_block(ImageReader reader, void *context, uint32_t offset,
+                          uint8_t *dst, uint8_t len)
+{
+  return 0 == len ? ECCX08_SUCCESS : reader(context, offset, dst, len);
+}
+
+static void read_ahead(void *context)
+{
+  StreamRead *next = (StreamRead *) context;
+
+  next->status = read_block(next->reader, next->context, next->offset,
+                            next->dst, next->len);
+}
+
+Sha256Costs::Sha256Costs()
+{
+  this->set(SHA256_DEVICE, SHA256_COST_DEVICE_FIXED_US,
+            SHA256_COST_DEVICE_BLOCK_US);
+  this->set(SHA256_SOFT, SHA256_COST_SOFT_FIXED_US,
+            SHA256_COST_SOFT_BLOCK_US);
+  this->set(SHA256_ASM, SHA256_COST_ASM_FIXED_US,
+            SHA256_COST_ASM_BLOCK_US);
+  this->set(SHA256_ATMEL, SHA256_COST_ATMEL_FIXED_US,
+            SHA256_COST_ATMEL_BLOCK_US);
+}
+
+/** Replace the estimated cost of a backend, e.g. with the values the
+ * hash_backends example measured on the target.
+ *
+ * \param[in] backend backend to change, SHA256_AUTO is ignored
+ * \param[in] fixed_us microseconds per message
+ * \param[in] block_us microseconds per 64 byte block
+ */
+void Sha256Costs::set(Sha256Backend backend, uint16_t fixed_us,
+                      uint16_t block_us)
+{
+  if (backend < SHA256_DEVICE || backend > SHA256_ATMEL)
+    return;
+
+  this->fixed_us[backend - SHA256_DEVICE] = fixed_us;
+  this->block_us[backend - SHA256_DEVICE] = block_us;
+}
+
+/** Estimated time to hash a message.
+ *
+ * \param[in] backend backend to estimate
+ * \param[in] len message length in bytes
+ * \return microseconds, or 0xFFFFFFFF for SHA256_AUTO
+ */
+uint32_t Sha256Costs::cost(Sha256Backend backend, uint32_t len) const
+{
+  // Padding adds a 0x80 byte and the 8 byte length.
+  uint32_t blocks = (len + 9 + 63) / 64;
+
+  if (backend < SHA256_DEVICE || backend > SHA256_ATMEL)
+    return 0xFFFFFFFFUL;
+
+  return this->fixed_us[backend - SHA256_DEVICE]
+    + blocks * this->block_us[backend - SHA256_DEVICE];
+}
+
+Sha256Hash::Sha256Hash(AtEccX08 *device)
+  : device(device)
+{
+}
+
+// With the costs of a device, see AtEccX08::setHashCost().
+Sha256Hash::Sha256Hash(AtEccX08 *device, const Sha256Costs &costs)
+  : device(device), costs(costs)
+{
+}
+
+/** Whether a backend can hash a message of a given length here.
+ *
+ * \param[in] backend backend to check
+ * \param[in] len message length in bytes
+ * \return true if hash() would use it when asked to
+ */
+bool Sha256Hash::available(Sha256Backend backend, uint32_t len) const
+{
+  switch (backend)
+    {
+    case SHA256_DEVICE:
+      return NULL != this->device;
+
+    case SHA256_SOFT:
+      return true;
+
+    case SHA256_ASM:
+#ifdef __AVR__
+      return true;
+#else
+      return false;
+#endif
+
+    case SHA256_ATMEL:
+      // The padding is wrong when the length word doesn't fit the block.
+      return len % 64 < 56 && len <= 0x7FFFFFFFUL;
+
+    default:
+      return false;
+    }
+}
+
+// See Sha256Costs::set().
+void Sha256Hash::setCost(Sha256Backend backend, uint16_t fixed_us,
+                         uint16_t block_us)
+{
+  this->costs.set(backend, fixed_us, block_us);
+}
+
+// See Sha256Costs::cost().
+uint32_t Sha256Hash::cost(Sha256Backend backend, uint32_t len) const
+{
+  return this->costs.cost(backend, len);
+}
+
+/** The cheapest backend available for a message length. */
+Sha256Backend Sha256Hash::choose(uint32_t len) const
+{
+  return this->cheapest(len, false);
+}
+
+/** The cheapest backend available for a message read from an ImageReader. */
+Sha256Backend Sha256Hash::chooseStream(uint32_t len) const
+{
+  return this->cheapest(len, true);
+}
+
+Sha256Backend Sha256Hash::cheapest(uint32_t len, bool stream) const
+{
+  static const Sha256Backend candidates[] =
+    { SHA256_ASM, SHA256_ATMEL, SHA256_SOFT, SHA256_DEVICE };
+  Sha256Backend best = SHA256_SOFT;
+
+  for (uint8_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
+    if ((!stream || SHA256_ATMEL != candidates[i])
+        && this->available(candidates[i], len)
+        && this->cost(candidates[i], len) < this->cost(best, len))
+      best = candidates[i];
+
+  return best;
+}
+
+/** SHA-256 of a message.
+ *
+ * \param[in] data message
+ * \param[in] len message length in bytes
+ * \param[out] digest 32 bytes
+ * \param[in] backend backend to use, SHA256_AUTO for the cheapest
+ * \return ECCX08_SUCCESS, ECCX08_BAD_PARAM if the backend is not available,
+ *         or the status of the device
+ */
+uint8_t Sha256Hash::hash(const uint8_t *data, uint32_t len, uint8_t *digest,
+                         Sha256Backend backend)
+{
+  if (SHA256_AUTO == backend)
+    backend = this->choose(len);
+
+  if (!digest || !this->available(backend, len))
+    return ECCX08_BAD_PARAM;
+
+  switch (backend)
+    {
+    case SHA256_DEVICE:
+      {
+        EccSha256 sha(*this->device);
+
+        sha.begin();
+        sha.update(data, len);
+        return sha.final(digest);
+      }
+
+    case SHA256_SOFT:
+      {
+        Sha256Class sha;
+
+        sha.init();
+        sha.write(data, len);
+        memcpy(digest, sha.result(), 32);
+        break;
+      }
+
+#ifdef __AVR__
+    case SHA256_ASM:
+      sha256((sha256_hash_t *) digest, data, len * 8);
+      break;
+#endif
+
+    case SHA256_ATMEL:
+      sha204h_calculate_sha256(len, const_cast<uint8_t *>(data), digest);
+      break;
+
+    default:
+      return ECCX08_BAD_PARAM;
+    }
+
+  return ECCX08_SUCCESS;
+}
+
+/** SHA-256 of a message read block by block, so it never has to be in
+ * memory as a whole.
+ *
+ * \param[in] reader reads the message
+ * \param[in] context passed to reader
+ * \param[in] len message length in bytes
+ * \param[out] digest 32 bytes
+ * \param[in] backend backend to use, SHA256_AUTO for the cheapest;
+ *            SHA256_ATMEL can't stream
+ * \return ECCX08_SUCCESS, ECCX08_BAD_PARAM if the backend is not available,
+ *         or the status of the reader or the device
+ */
+uint8_t Sha256Hash::hash(ImageReader reader, void *context, uint32_t len,
+                         uint8_t *digest, Sha256Backend backend)
+{
+  if (SHA256_AUTO == backend)
+    backend = this->chooseStream(len);
+
+  if (!reader || !digest || SHA256_ATMEL == backend
+      || !this->available(backend, len))
+    return ECCX08_BAD_PARAM;
+
+  if (SHA256_DEVICE == backend)
+    return this->hashDevice(reader, context, len, digest);
+
+  uint8_t block[64];
+  uint8_t ret_code = ECCX08_SUCCESS;
+  uint32_t offset = 0;
+
+  switch (backend)
+    {
+    case SHA256_SOFT:
+      {
+        Sha256Class sha;
+
+        sha.init();
+        while (ECCX08_SUCCESS == ret_code && offset < len)
+          {
+            uint8_t n = len - offset < sizeof(block) ? len - offset
+              : sizeof(block);
+
+            ret_code = read_block(reader, context, offset, block, n);
+            sha.write(block, n);
+            offset += n;
+          }
+        memcpy(digest, sha.result(), 32);
+        break;
+      }
+
+#ifdef __AVR__
+    case SHA256_ASM:
+      {
+        sha256_ctx_t ctx;
+
+        sha256_init(&ctx);
+        while (ECCX08_SUCCESS == ret_code)
+          {
+            uint8_t n = len - offset < sizeof(block) ? len - offset
+              : sizeof(block);
+
+            ret_code = read_block(reader, context, offset, block, n);
+            offset += n;
+            if (sizeof(block) != n)
+              {
+                sha256_lastBlock(&ctx, block, n * 8);
+                break;
+              }
+            sha256_nextBlock(&ctx, block);
+          }
+        sha256_ctx2hash((sha256_hash_t *) digest, &ctx);
+        break;
+      }
+#endif
+
+    default:
+      return ECCX08_BAD_PARAM;
+    }
+
+  memset(block, 0, sizeof(block));
+  return ret_code;
+}
+
+/** Stream a message through EccSha256, reading each block into the other
+ * half of a double buffer while the device runs the Update of the last.
+ */
+uint8_t Sha256Hash::hashDevice(ImageReader reader, void *context,
+                               uint32_t len, uint8_t *digest)
+{
+  uint8_t blocks[2][64];
+  uint8_t current = 0;
+  uint32_t offset = 0;
+  EccSha256 sha(*this->device);
+  StreamRead next = { reader, context, 0, NULL, 0, ECCX08_SUCCESS };
+
+  uint8_t n = len < sizeof(blocks[0]) ? len : sizeof(blocks[0]);
+  uint8_t ret_code = read_block(reader, context, 0, blocks[current], n);
+
+  if (ECCX08_SUCCESS == ret_code)
+    ret_code = sha.begin();
+
+  while (ECCX08_SUCCESS == ret_code && sizeof(blocks[0]) == n)
+    {
+      // A full block goes out as one Update, read the next one meanwhile.
+      offset += n;
+      next.offset = offset;
+      next.dst = blocks[current ^ 1];
+      next.len = len - offset < sizeof(blocks[0]) ? len - offset
+        : sizeof(blocks[0]);
+      next.status = ECCX08_FUNC_FAIL;
+
+      {
+        AtEccX08::ExecutionHook hook(*this->device, read_ahead, &next);
+        ret_code = sha.update(blocks[current], n);
+      }
+
+      if (ECCX08_SUCCESS == ret_code)
+        ret_code = next.status;
+
+      current ^= 1;
+      n = next.len;
+    }
+
+  if (ECCX08_SUCCESS == ret_code)
+    {
+      sha.update(blocks[current], n);
+      ret_code = sha.final(digest);
+    }
+
+  return ret_code;
+}
@@ -0,0 +1,131 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_SHA256HASH_H_
+#define LIB_SHA256HASH_H_
+
+#include <Arduino.h>
+#include "ImageSource.h"
+
+class AtEccX08;
+
+/* Default costs of the SHA-256 backends in microseconds, see Sha256Costs.
+   They are estimates for a 16 MHz AVR with the device on a 400 kHz bus,
+   not measurements. Sha256Costs is built in Sha256Hash.cpp, so only a
+   global build flag (-DSHA256_COST_...) changes them; a #define in a
+   sketch does not. Use setCost() or AtEccX08::setHashCost() at run time. */
+#ifndef SHA256_COST_DEVICE_FIXED_US
+#define SHA256_COST_DEVICE_FIXED_US 12000
+#endif
+
+#ifndef SHA256_COST_DEVICE_BLOCK_US
+#define SHA256_COST_DEVICE_BLOCK_US 9000
+#endif
+
+#ifndef SHA256_COST_ASM_FIXED_US
+#define SHA256_COST_ASM_FIXED_US 200
+#endif
+
+#ifndef SHA256_COST_ASM_BLOCK_US
+#define SHA256_COST_ASM_BLOCK_US 1100
+#endif
+
+#ifndef SHA256_COST_SOFT_FIXED_US
+#define SHA256_COST_SOFT_FIXED_US 100
+#endif
+
+#ifndef SHA256_COST_SOFT_BLOCK_US
+#define SHA256_COST_SOFT_BLOCK_US 4500
+#endif
+
+#ifndef SHA256_COST_ATMEL_FIXED_US
+#define SHA256_COST_ATMEL_FIXED_US 50
+#endif
+
+#ifndef SHA256_COST_ATMEL_BLOCK_US
+#define SHA256_COST_ATMEL_BLOCK_US 3700
+#endif
+
+enum Sha256Backend
+{
+  SHA256_AUTO,
+  SHA256_DEVICE,        // SHA command of the device, see EccSha256
+  SHA256_SOFT,          // Sha256Class
+  SHA256_ASM,           // sha256() in assembler, AVR only
+  SHA256_ATMEL          // sha204h_calculate_sha256(), len % 64 < 56 only
+};
+
+/* The cost of each backend, a fixed part per message plus a part per 64
+   byte block, padding included, in microseconds. */
+struct Sha256Costs
+{
+  Sha256Costs();
+
+  void set(Sha256Backend backend, uint16_t fixed_us, uint16_t block_us);
+  uint32_t cost(Sha256Backend backend, uint32_t len) const;
+
+  // Indexed by backend - SHA256_DEVICE.
+  uint16_t fixed_us[4];
+  uint16_t block_us[4];
+};
+
+/* One entry point for SHA-256 over a message in memory. Unless told
+   otherwise it picks the backend with the lowest cost for the length out
+   of those that are built for the target and can take the message. The
+   device is only a candidate if one was given.
+
+     Sha256Hash hasher(&ecc);
+     hasher.hash(message, len, digest);
+
+   A message that does not fit in memory is read in blocks of 64 bytes
+   from an ImageReader instead. sha204h_calculate_sha256() needs all of it
+   at once and is left out then. On the device the next block is read
+   while the device hashes the current one.
+
+   The costs start as the SHA256_COST_ estimates. The hash_backends
+   example measures them on the target and prints the setCost() calls
+   that replace them. hash_verify() and verifyImage() of AtEccX08 use the
+   costs set with AtEccX08::setHashCost().
+*/
+class Sha256Hash
+{
+public:
+  explicit Sha256Hash(AtEccX08 *device = NULL);
+  Sha256Hash(AtEccX08 *device, const Sha256Costs &costs);
+
+  uint8_t hash(const uint8_t *data, uint32_t len, uint8_t *digest,
+               Sha256Backend backend = SHA256_AUTO);
+  uint8_t hash(ImageReader reader, void *context, uint32_t len,
+               uint8_t *digest, Sha256Backend backend = SHA256_AUTO);
+  Sha256Backend choose(uint32_t len) const;
+  Sha256Backend chooseStream(uint32_t len) const;
+  bool available(Sha256Backend backend, uint32_t len) const;
+  uint32_t cost(Sha256Backend backend, uint32_t len) const;
+  void setCost(Sha256Backend backend, uint16_t fixed_us, uint16_t block_us);
+
+private:
+  Sha256Backend cheapest(uint32_t len, bool stream) const;
+  uint8_t hashDevice(ImageReader reader, void *context, uint32_t len,
+                     uint8_t *digest);
+
+  AtEccX08 *device;
+  Sha256Costs costs;
+};
+
+#endif
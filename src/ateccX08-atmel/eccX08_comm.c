@@ -22,16 +22,19 @@
 
  
 
-/** \brief This function calculates CRC.
+/** \brief This function feeds data into a running CRC.
+ *
+ * Start with a CRC register of 0 and call this function once for every
+ * block of a packet to obtain the CRC of the concatenated blocks.
  *
+ * \param[in] crc_register CRC of the preceding blocks
  * \param[in] length number of bytes in buffer
  * \param[in] data pointer to data for which CRC should be calculated
- * \param[out] crc pointer to 16-bit CRC
+ * \return CRC register after processing the data
  */
-void eccX08c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc)
+uint16_t eccX08c_update_crc(uint16_t crc_register, uint8_t length, const uint8_t *data)
 {
 	uint8_t counter;
-	uint16_t crc_register = 0;
 	uint16_t polynom = 0x8005;
 	uint8_t shift_register;
 	uint8_t data_bit, crc_bit;
@@ -48,6 +51,20 @@ void eccX08c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc)
 		}
 	}
 	
+	return crc_register;
+}
+
+
+/** \brief This function calculates CRC.
+ *
+ * \param[in] length number of bytes in buffer
+ * \param[in] data pointer to data for which CRC should be calculated
+ * \param[out] crc pointer to 16-bit CRC
+ */
+void eccX08c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc)
+{
+	uint16_t crc_register = eccX08c_update_crc(0, length, data);
+	
 	crc[0] = (uint8_t) (crc_register & 0x00FF);
 	crc[1] = (uint8_t) (crc_register >> 8);
 }
@@ -165,6 +182,48 @@ uint8_t eccX08c_resync(uint8_t size, uint8_t *response)
  */
 uint8_t eccX08c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer,
 	uint8_t execution_delay, uint8_t execution_timeout)
+{
+	uint8_t count = tx_buffer[ECCX08_BUFFER_POS_COUNT];
+	uint8_t count_minus_crc = count - ECCX08_CRC_SIZE;
+	eccX08_iovec_t tx_iov;
+	
+	// Append CRC.
+	eccX08c_calculate_crc(count_minus_crc, tx_buffer, tx_buffer + count_minus_crc);
+	
+	tx_iov.data = tx_buffer;
+	tx_iov.length = count;
+	
+	return eccX08c_send_and_receive_iov(1, &tx_iov, rx_size, rx_buffer,
+		execution_delay, execution_timeout, NULL, NULL);
+}
+
+
+/** \brief This function runs a communication sequence for a command that is
+ * scattered over several blocks: send command, delay, and verify response after receiving it.
+ *
+ * The blocks have to form a complete command packet including count byte and CRC.
+ * They are sent as they are, and are re-sent unchanged if a retry is needed.
+ * Retries and error handling are the same as for #eccX08c_send_and_receive.
+ *
+ * A hook lets the host work while the device executes the command. It is called
+ * once right after the command went out, instead of waiting for the typical
+ * execution time, and the response is then polled for up to the maximum execution
+ * time. Retries wait as usual. Work that takes longer than the command just delays
+ * reading the response.
+ *
+ * \param[in] iov_count number of command blocks
+ * \param[in] tx_iov pointer to list of command blocks
+ * \param[in] rx_size size of response buffer
+ * \param[out] rx_buffer pointer to response buffer
+ * \param[in] execution_delay Start polling for a response after this many ms .
+ * \param[in] execution_timeout polling timeout in ms
+ * \param[in] hook host work in place of the execution delay, or NULL
+ * \param[in] hook_context passed to hook
+ * \return status of the operation
+ */
+uint8_t eccX08c_send_and_receive_iov(uint8_t iov_count, const eccX08_iovec_t *tx_iov,
+	uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout,
+	eccX08c_execution_hook_t hook, void *hook_context)
 {
 	uint8_t ret_code = ECCX08_FUNC_FAIL;
 	uint8_t ret_code_resync;
@@ -172,21 +231,16 @@ uint8_t eccX08c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *r
 	uint8_t n_retries_receive;
 	uint8_t i;
 	uint8_t status_byte;
-	uint8_t count = tx_buffer[ECCX08_BUFFER_POS_COUNT];
-	uint8_t count_minus_crc = count - ECCX08_CRC_SIZE;
 	uint16_t execution_timeout_us = (uint16_t) (execution_timeout * 1000) + ECCX08_RESPONSE_TIMEOUT;
 	volatile uint16_t timeout_countdown;
 	
-	// Append CRC.
-	eccX08c_calculate_crc(count_minus_crc, tx_buffer, tx_buffer + count_minus_crc);
-	
 	// Retry loop for sending a command and receiving a response.
 	n_retries_send = ECCX08_RETRY_COUNT + 1;
 	
 	while ((n_retries_send-- > 0) && (ret_code != ECCX08_SUCCESS))
 	{
 		// Send command.
-		ret_code = eccX08p_send_command(count, tx_buffer);
+		ret_code = eccX08p_send_command_iov(iov_count, tx_iov);
 		if (ret_code != ECCX08_SUCCESS)
 		{
 			if (eccX08c_resync(rx_size, rx_buffer) == ECCX08_RX_NO_RESPONSE) {
@@ -197,8 +251,15 @@ uint8_t eccX08c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *r
 				continue;
 		}
 		
-		// Wait minimum command execution time and then start polling for a response.
-		delay_ms(execution_delay);
+		// Wait minimum command execution time, or do the host work, and then start polling
+		// for a response.
+		if (hook) {
+			hook(hook_context);
+			hook = NULL;
+			execution_timeout_us += (uint16_t) (execution_delay * 1000);
+		}
+		else
+			delay_ms(execution_delay);
 		
 		// Retry loop for receiving a response.
 		n_retries_receive = ECCX08_RETRY_COUNT + 1;
@@ -46,6 +46,9 @@ extern "C" {
 //! buffer index of first data byte in data response
 #define ECCX08_BUFFER_POS_DATA		(1)
 
+//! status byte after a CheckMac or Verify miscompare
+#define ECCX08_STATUS_BYTE_MISCOMPARE	((uint8_t) 0x01)
+
 //! status byte after wake-up
 #define ECCX08_STATUS_BYTE_WAKEUP	((uint8_t) 0x11)
 
@@ -58,12 +61,18 @@ extern "C" {
 //! communication error
 #define ECCX08_STATUS_BYTE_COMM		((uint8_t) 0xFF)
 
+//! host work run while the device executes a command, see eccX08c_send_and_receive_iov()
+typedef void (*eccX08c_execution_hook_t)(void *context);
+
 
+uint16_t	eccX08c_update_crc(uint16_t crc_register, uint8_t length, const uint8_t *data);
 void	eccX08c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc);
 uint8_t	ecc108c_check_crc(uint8_t *response);
 uint8_t	eccX08c_wakeup(uint8_t *response);
 uint8_t	ecc108c_resync(uint8_t size, uint8_t *response);
 uint8_t	eccX08c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout);
+uint8_t	eccX08c_send_and_receive_iov(uint8_t iov_count, const eccX08_iovec_t *tx_iov, uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout,
+			eccX08c_execution_hook_t hook, void *hook_context);
 
 #endif
 #ifdef __cplusplus
@@ -38,7 +38,6 @@
 * \atmel_crypto_device_library_license_stop
  */
 
-#include <string.h>						// needed for memcpy()
 
 #include "eccX08_lib_return_codes.h"	// declarations of function return codes
 #include "eccX08_comm_marshaling.h"		// definitions and declarations for the Command Marshaling module
@@ -70,8 +69,11 @@ uint8_t eccX08m_check_parameters(uint8_t op_code, uint8_t param1, uint16_t param
 	uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer)
 {
 #ifdef ECCX08_CHECK_PARAMETERS
-	uint8_t len = datalen1 + datalen2 + datalen3 + ECCX08_CMD_SIZE_MIN;
-	if (!tx_buffer || (tx_size < len) || (rx_size < ECCX08_RSP_SIZE_MIN) || !rx_buffer)
+	// Data blocks are sent from where they are. The tx buffer holds only
+	// count, op-code, parameters and CRC.
+	uint16_t len = datalen1 + datalen2 + datalen3 + ECCX08_CMD_SIZE_MIN;
+	if (!tx_buffer || (tx_size < ECCX08_CMD_SIZE_MIN) || (len > ECCX08_CMD_SIZE_MAX)
+			|| (rx_size < ECCX08_RSP_SIZE_MIN) || !rx_buffer)
 		return ECCX08_BAD_PARAM;
 		
 	if ((datalen1 > 0 && !data1) || (datalen2 > 0 && !data2) || (datalen3 > 0 && !data3))
@@ -205,182 +207,226 @@ uint8_t eccX08m_check_parameters(uint8_t op_code, uint8_t param1, uint16_t param
 }
 
 
-/** \brief This function creates a command packet, sends it, and receives its response.
+/** \brief This function supplies the execution delays and the response size of a command.
  *
  * \param[in] op_code command op-code
  * \param[in] param1 first parameter
- * \param[in] param2 second parameter
- * \param[in] datalen1 number of bytes in first data block
- * \param[in] data1 pointer to first data block
- * \param[in] datalen2 number of bytes in second data block
- * \param[in] data2 pointer to second data block
- * \param[in] datalen3 number of bytes in third data block
- * \param[in] data3 pointer to third data block
- * \param[in] tx_size size of tx buffer
- * \param[in] tx_buffer pointer to tx buffer
- * \param[in] rx_size size of rx buffer
- * \param[out] rx_buffer pointer to rx buffer
- * \return status of the operation
+ * \param[in] rx_size size of rx buffer, used as response size for commands of variable length
+ * \param[out] poll_delay time in ms to wait before polling for the response
+ * \param[out] poll_timeout time in ms to keep polling for the response
+ * \param[out] response_size expected size of the response
  */
-uint8_t eccX08m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
-	uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
-	uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer)
+void eccX08m_get_timing(uint8_t op_code, uint8_t param1, uint8_t rx_size,
+	uint8_t *poll_delay, uint8_t *poll_timeout, uint8_t *response_size)
 {
-	uint8_t poll_delay, poll_timeout, response_size;
-	uint8_t *p_buffer;
-	uint8_t len;
-	
-	// Define ECCX08_CHECK_PARAMETERS to compile and link this feature.
-	uint8_t ret_code = eccX08m_check_parameters(op_code, param1, param2,
-		datalen1, data1, datalen2, data2, datalen3, data3,
-		tx_size, tx_buffer, rx_size, rx_buffer);
-	if (ret_code != ECCX08_SUCCESS)
-		return ret_code;
-		
-	// Supply delays and response size.
 	switch (op_code)
 	{
 	case ECCX08_CHECKMAC:
-		poll_delay = CHECKMAC_DELAY;
-		poll_timeout = CHECKMAC_EXEC_MAX - CHECKMAC_DELAY;
-		response_size = CHECKMAC_RSP_SIZE;
+		*poll_delay = CHECKMAC_DELAY;
+		*poll_timeout = CHECKMAC_EXEC_MAX - CHECKMAC_DELAY;
+		*response_size = CHECKMAC_RSP_SIZE;
 		break;
 		
 	case ECCX08_DERIVE_KEY:
-		poll_delay = DERIVE_KEY_DELAY;
-		poll_timeout = DERIVE_KEY_EXEC_MAX - DERIVE_KEY_DELAY;
-		response_size = DERIVE_KEY_RSP_SIZE;
+		*poll_delay = DERIVE_KEY_DELAY;
+		*poll_timeout = DERIVE_KEY_EXEC_MAX - DERIVE_KEY_DELAY;
+		*response_size = DERIVE_KEY_RSP_SIZE;
 		break;
 		
 	case ECCX08_GENDIG:
-		poll_delay = GENDIG_DELAY;
-		poll_timeout = GENDIG_EXEC_MAX - GENDIG_DELAY;
-		response_size = GENDIG_RSP_SIZE;
+		*poll_delay = GENDIG_DELAY;
+		*poll_timeout = GENDIG_EXEC_MAX - GENDIG_DELAY;
+		*response_size = GENDIG_RSP_SIZE;
 		break;
 		
 	case ECCX08_GENKEY:
-		poll_delay = GENKEY_DELAY;
-		poll_timeout = GENKEY_EXEC_MAX - GENKEY_DELAY;
+		*poll_delay = GENKEY_DELAY;
+		*poll_timeout = GENKEY_EXEC_MAX - GENKEY_DELAY;
 //	#define GENKEY_RSP_SIZE_MEDIUM			ECCX08_RSP_SIZE_64	//!< response size when generating 256-bit key
 //	#define GENKEY_RSP_SIZE_LONG			ECCX08_RSP_SIZE_MAX	//!< response size when generating 283-bit key
 
-		response_size = param1 == GENKEY_MODE_DIGEST //todo: differentiate 256 keys with 283 keys
+		*response_size = param1 == GENKEY_MODE_DIGEST //todo: differentiate 256 keys with 283 keys
 			? GENKEY_RSP_SIZE_SHORT : GENKEY_RSP_SIZE_MEDIUM;		//GENKEY_RSP_SIZE_LONG;
 		break;
 		
 	case ECCX08_HMAC:
-		poll_delay = HMAC_DELAY;
-		poll_timeout = HMAC_EXEC_MAX - HMAC_DELAY;
-		response_size = HMAC_RSP_SIZE;
+		*poll_delay = HMAC_DELAY;
+		*poll_timeout = HMAC_EXEC_MAX - HMAC_DELAY;
+		*response_size = HMAC_RSP_SIZE;
 		break;
 		
 	case ECCX08_INFO:
-		poll_delay = INFO_DELAY;
-		poll_timeout = INFO_EXEC_MAX - INFO_DELAY;
-		response_size = INFO_RSP_SIZE;
+		*poll_delay = INFO_DELAY;
+		*poll_timeout = INFO_EXEC_MAX - INFO_DELAY;
+		*response_size = INFO_RSP_SIZE;
 		break;
 		
 	case ECCX08_LOCK:
-		poll_delay = LOCK_DELAY;
-		poll_timeout = LOCK_EXEC_MAX - LOCK_DELAY;
-		response_size = LOCK_RSP_SIZE;
+		*poll_delay = LOCK_DELAY;
+		*poll_timeout = LOCK_EXEC_MAX - LOCK_DELAY;
+		*response_size = LOCK_RSP_SIZE;
 		break;
 		
 	case ECCX08_MAC:
-		poll_delay = MAC_DELAY;
-		poll_timeout = MAC_EXEC_MAX - MAC_DELAY;
-		response_size = MAC_RSP_SIZE;
+		*poll_delay = MAC_DELAY;
+		*poll_timeout = MAC_EXEC_MAX - MAC_DELAY;
+		*response_size = MAC_RSP_SIZE;
 		break;
 		
 	case ECCX08_NONCE:
-		poll_delay = NONCE_DELAY;
-		poll_timeout = NONCE_EXEC_MAX - NONCE_DELAY;
-		response_size = param1 == NONCE_MODE_PASSTHROUGH
+		*poll_delay = NONCE_DELAY;
+		*poll_timeout = NONCE_EXEC_MAX - NONCE_DELAY;
+		*response_size = param1 == NONCE_MODE_PASSTHROUGH
 			? NONCE_RSP_SIZE_SHORT : NONCE_RSP_SIZE_LONG;
 		break;
 		
 	case ECCX08_PAUSE:
-		poll_delay = PAUSE_DELAY;
-		poll_timeout = PAUSE_EXEC_MAX - PAUSE_DELAY;
-		response_size = PAUSE_RSP_SIZE;
+		*poll_delay = PAUSE_DELAY;
+		*poll_timeout = PAUSE_EXEC_MAX - PAUSE_DELAY;
+		*response_size = PAUSE_RSP_SIZE;
 		break;
 		
 	case ECCX08_PRIVWRITE:
-		poll_delay = PRIVWRITE_DELAY;
-		poll_timeout = PRIVWRITE_EXEC_MAX - PRIVWRITE_DELAY;
-		response_size = PRIVWRITE_RSP_SIZE;
+		*poll_delay = PRIVWRITE_DELAY;
+		*poll_timeout = PRIVWRITE_EXEC_MAX - PRIVWRITE_DELAY;
+		*response_size = PRIVWRITE_RSP_SIZE;
 		break;
 		
 	case ECCX08_RANDOM:
-		poll_delay = RANDOM_DELAY;
-		poll_timeout = RANDOM_EXEC_MAX - RANDOM_DELAY;
-		response_size = RANDOM_RSP_SIZE;
+		*poll_delay = RANDOM_DELAY;
+		*poll_timeout = RANDOM_EXEC_MAX - RANDOM_DELAY;
+		*response_size = RANDOM_RSP_SIZE;
 		break;
 		
 	case ECCX08_READ:
-		poll_delay = READ_DELAY;
-		poll_timeout = READ_EXEC_MAX - READ_DELAY;
-		response_size = (param1 & ECCX08_ZONE_COUNT_FLAG)
+		*poll_delay = READ_DELAY;
+		*poll_timeout = READ_EXEC_MAX - READ_DELAY;
+		*response_size = (param1 & ECCX08_ZONE_COUNT_FLAG)
 			? READ_32_RSP_SIZE : READ_4_RSP_SIZE;
 		break;
 		
 	case ECCX08_SIGN:
-		poll_delay = SIGN_DELAY;
-		poll_timeout = SIGN_EXEC_MAX - SIGN_DELAY;
-		//response_size = SIGN_RSP_SIZE_LONG; //todo: differentiate 256 keys with 283 keys
-		response_size = SIGN_RSP_SIZE_SHORT;  // 256 bit keys
+		*poll_delay = SIGN_DELAY;
+		*poll_timeout = SIGN_EXEC_MAX - SIGN_DELAY;
+		//*response_size = SIGN_RSP_SIZE_LONG; //todo: differentiate 256 keys with 283 keys
+		*response_size = SIGN_RSP_SIZE_SHORT;  // 256 bit keys
 		break;
 		
 	case ECCX08_TEMPSENSE:
-		poll_delay = TEMPSENSE_DELAY;
-		poll_timeout = TEMPSENSE_EXEC_MAX - TEMPSENSE_DELAY;
-		response_size = TEMPSENSE_RSP_SIZE;
+		*poll_delay = TEMPSENSE_DELAY;
+		*poll_timeout = TEMPSENSE_EXEC_MAX - TEMPSENSE_DELAY;
+		*response_size = TEMPSENSE_RSP_SIZE;
 		break;
 		
 	case ECCX08_UPDATE_EXTRA:
-		poll_delay = UPDATE_DELAY;
-		poll_timeout = UPDATE_EXEC_MAX - UPDATE_DELAY;
-		response_size = UPDATE_RSP_SIZE;
+		*poll_delay = UPDATE_DELAY;
+		*poll_timeout = UPDATE_EXEC_MAX - UPDATE_DELAY;
+		*response_size = UPDATE_RSP_SIZE;
 		break;
 		
 	case ECCX08_VERIFY:
-		poll_delay = VERIFY_DELAY;
-		poll_timeout = VERIFY_EXEC_MAX - VERIFY_DELAY;
-		response_size = VERIFY_RSP_SIZE;
+		*poll_delay = VERIFY_DELAY;
+		*poll_timeout = VERIFY_EXEC_MAX - VERIFY_DELAY;
+		*response_size = VERIFY_RSP_SIZE;
 		break;
 		
 	case ECCX08_WRITE:
-		poll_delay = WRITE_DELAY;
-		poll_timeout = WRITE_EXEC_MAX - WRITE_DELAY;
-		response_size = WRITE_RSP_SIZE;
+		*poll_delay = WRITE_DELAY;
+		*poll_timeout = WRITE_EXEC_MAX - WRITE_DELAY;
+		*response_size = WRITE_RSP_SIZE;
 		break;
 		
 	case ECCX08_SHA:
-		poll_delay = SHA_DELAY;
-		poll_timeout = SHA_EXEC_MAX - SHA_DELAY;
-		response_size = param1 == 0x02
+		*poll_delay = SHA_DELAY;
+		*poll_timeout = SHA_EXEC_MAX - SHA_DELAY;
+		*response_size = (param1 == SHA_MODE_END || param1 == SHA_MODE_HMAC_END)
 			? SHA_RSP_SIZE_LONG : SHA_RSP_SIZE_SHORT;
 		break;
 		
 	case ECCX08_COUNTER:
-		poll_delay = COUNTER_DELAY;
-		poll_timeout = COUNTER_EXEC_MAX - COUNTER_DELAY;
-		response_size = COUNTER_RSP_SIZE;
+		*poll_delay = COUNTER_DELAY;
+		*poll_timeout = COUNTER_EXEC_MAX - COUNTER_DELAY;
+		*response_size = COUNTER_RSP_SIZE;
 		break;
 		
 	case ECCX08_ECDH:
-		poll_delay = ECDH_DELAY;
-		poll_timeout = ECDH_EXEC_MAX - ECDH_DELAY;
-		response_size = rx_size;
+		*poll_delay = ECDH_DELAY;
+		*poll_timeout = ECDH_EXEC_MAX - ECDH_DELAY;
+		*response_size = rx_size;
 		break;
 		
 	default:
-		poll_delay = 0;
-		poll_timeout = ECCX08_COMMAND_EXEC_MAX;
-		response_size = rx_size;
+		*poll_delay = 0;
+		*poll_timeout = ECCX08_COMMAND_EXEC_MAX;
+		*response_size = rx_size;
 	}
+}
+
+
+/** \brief This function creates a command packet, sends it, and receives its response.
+ *
+ * The data blocks are not copied. Only count, op-code, parameters and CRC are
+ * written to the tx buffer, which therefore needs to hold no more than
+ * #ECCX08_CMD_SIZE_MIN bytes. The packet is sent straight from the tx buffer
+ * and the data blocks, and the CRC is calculated once over all of them.
+ *
+ * \param[in] op_code command op-code
+ * \param[in] param1 first parameter
+ * \param[in] param2 second parameter
+ * \param[in] datalen1 number of bytes in first data block
+ * \param[in] data1 pointer to first data block
+ * \param[in] datalen2 number of bytes in second data block
+ * \param[in] data2 pointer to second data block
+ * \param[in] datalen3 number of bytes in third data block
+ * \param[in] data3 pointer to third data block
+ * \param[in] tx_size size of tx buffer, at least #ECCX08_CMD_SIZE_MIN
+ * \param[in] tx_buffer pointer to tx buffer
+ * \param[in] rx_size size of rx buffer
+ * \param[out] rx_buffer pointer to rx buffer
+ * \return status of the operation
+ */
+uint8_t eccX08m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
+	uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+	uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer)
+{
+	return eccX08m_execute_hook(op_code, param1, param2, datalen1, data1, datalen2, data2,
+		datalen3, data3, tx_size, tx_buffer, rx_size, rx_buffer, NULL, NULL);
+}
+
+
+/** \brief This function works like #eccX08m_execute, and lets the host work while
+ * the device executes the command.
+ *
+ * The hook is called once right after the command went out, see
+ * #eccX08c_send_and_receive_iov. It must not send commands to the device.
+ *
+ * \param[in] hook host work in place of the execution delay, or NULL
+ * \param[in] hook_context passed to hook
+ * \return status of the operation
+ */
+uint8_t eccX08m_execute_hook(uint8_t op_code, uint8_t param1, uint16_t param2,
+	uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+	uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer,
+	eccX08c_execution_hook_t hook, void *hook_context)
+{
+	uint8_t poll_delay, poll_timeout, response_size;
+	uint8_t *p_buffer;
+	uint8_t len;
+	uint16_t crc_register;
+	eccX08_iovec_t tx_iov[5];
+	uint8_t iov_count = 0;
+	
+	// Define ECCX08_CHECK_PARAMETERS to compile and link this feature.
+	uint8_t ret_code = eccX08m_check_parameters(op_code, param1, param2,
+		datalen1, data1, datalen2, data2, datalen3, data3,
+		tx_size, tx_buffer, rx_size, rx_buffer);
+	if (ret_code != ECCX08_SUCCESS)
+		return ret_code;
+		
+	// Supply delays and response size.
+	eccX08m_get_timing(op_code, param1, rx_size, &poll_delay, &poll_timeout, &response_size);
 	
-	// Assemble command.
+	// Assemble command header. Data blocks are sent from the caller's buffers.
 	len = datalen1 + datalen2 + datalen3 + ECCX08_CMD_SIZE_MIN;
 	p_buffer = tx_buffer;
 	*p_buffer++ = len;
@@ -389,27 +435,38 @@ uint8_t eccX08m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
 	*p_buffer++ = param2 & 0xFF;
 	*p_buffer++ = param2 >> 8;
 	
+	tx_iov[iov_count].data = tx_buffer;
+	tx_iov[iov_count++].length = ECCX08_DATA_IDX;
+	crc_register = eccX08c_update_crc(0, ECCX08_DATA_IDX, tx_buffer);
+	
 	if (datalen1 > 0)
 	{
-		memcpy(p_buffer, data1, datalen1);
-		p_buffer += datalen1;
+		tx_iov[iov_count].data = data1;
+		tx_iov[iov_count++].length = datalen1;
+		crc_register = eccX08c_update_crc(crc_register, datalen1, data1);
 	}
 	if (datalen2 > 0)
 	{
-		memcpy(p_buffer, data2, datalen2);
-		p_buffer += datalen2;
+		tx_iov[iov_count].data = data2;
+		tx_iov[iov_count++].length = datalen2;
+		crc_register = eccX08c_update_crc(crc_register, datalen2, data2);
 	}
 	if (datalen3 > 0)
 	{
-		memcpy(p_buffer, data3, datalen3);
-		p_buffer += datalen3;
+		tx_iov[iov_count].data = data3;
+		tx_iov[iov_count++].length = datalen3;
+		crc_register = eccX08c_update_crc(crc_register, datalen3, data3);
 	}
 	
-	eccX08c_calculate_crc(len - ECCX08_CRC_SIZE, tx_buffer, p_buffer);
+	// Append CRC behind the header in the tx buffer.
+	*p_buffer++ = (uint8_t) (crc_register & 0x00FF);
+	*p_buffer = (uint8_t) (crc_register >> 8);
+	tx_iov[iov_count].data = &tx_buffer[ECCX08_DATA_IDX];
+	tx_iov[iov_count++].length = ECCX08_CRC_SIZE;
 	
 	// Send command and receive response.
-	ret_code = eccX08c_send_and_receive(&tx_buffer[0], response_size,
-		&rx_buffer[0],	poll_delay, poll_timeout);
+	ret_code = eccX08c_send_and_receive_iov(iov_count, tx_iov, response_size,
+		&rx_buffer[0],	poll_delay, poll_timeout, hook, hook_context);
 		
 	// Put device to sleep if command fails
 	if (ret_code != ECCX08_SUCCESS)
@@ -417,3 +474,42 @@ uint8_t eccX08m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
 		
 	return ret_code;
 }
+
+
+/** \brief This function sends a complete, prebuilt command packet and receives its response.
+ *
+ * The packet already holds count, op-code, parameters, data and CRC, for
+ * instance a frame built at compile time, and is sent without any
+ * assembly or CRC calculation.
+ *
+ * \param[in] frame pointer to command packet
+ * \param[in] rx_size size of rx buffer
+ * \param[out] rx_buffer pointer to rx buffer
+ * \return status of the operation
+ */
+uint8_t eccX08m_execute_frame(uint8_t *frame, uint8_t rx_size, uint8_t *rx_buffer)
+{
+	uint8_t poll_delay, poll_timeout, response_size;
+	eccX08_iovec_t tx_iov;
+	uint8_t ret_code;
+	
+	if (!frame || frame[ECCX08_COUNT_IDX] < ECCX08_CMD_SIZE_MIN
+			|| rx_size < ECCX08_RSP_SIZE_MIN || !rx_buffer)
+		return ECCX08_BAD_PARAM;
+	
+	eccX08m_get_timing(frame[ECCX08_OPCODE_IDX], frame[ECCX08_PARAM1_IDX], rx_size,
+		&poll_delay, &poll_timeout, &response_size);
+	
+	tx_iov.data = frame;
+	tx_iov.length = frame[ECCX08_COUNT_IDX];
+	
+	// Send command and receive response.
+	ret_code = eccX08c_send_and_receive_iov(1, &tx_iov, response_size,
+		&rx_buffer[0], poll_delay, poll_timeout, NULL, NULL);
+	
+	// Put device to sleep if command fails
+	if (ret_code != ECCX08_SUCCESS)
+		(void) eccX08p_sleep();
+	
+	return ret_code;
+}
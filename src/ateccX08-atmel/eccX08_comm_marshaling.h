@@ -667,6 +667,16 @@ uint8_t eccX08m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
 			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
 			uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer);
 
+uint8_t eccX08m_execute_hook(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer,
+			eccX08c_execution_hook_t hook, void *hook_context);
+
+uint8_t eccX08m_execute_frame(uint8_t *frame, uint8_t rx_size, uint8_t *rx_buffer);
+
+void eccX08m_get_timing(uint8_t op_code, uint8_t param1, uint8_t rx_size,
+			uint8_t *poll_delay, uint8_t *poll_timeout, uint8_t *response_size);
+
 /** @} */
 
 #endif
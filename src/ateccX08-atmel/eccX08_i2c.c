@@ -215,6 +215,39 @@ uint8_t eccX08p_send_command(uint8_t count, uint8_t *command)
 }
 
 
+/** \brief This I2C function sends a command that is scattered over several blocks.
+ *
+ *         All blocks are sent in one I2C packet, so the device sees the same
+ *         byte stream as if the command had been assembled in a single buffer.
+ * \param[in] iov_count number of blocks
+ * \param[in] iov pointer to list of blocks
+ * \return status of the operation
+ */
+uint8_t eccX08p_send_command_iov(uint8_t iov_count, const eccX08_iovec_t *iov)
+{
+	uint8_t word_address = ECCX08_I2C_PACKET_FUNCTION_NORMAL;
+	uint8_t i2c_status = eccX08p_send_slave_address(I2C_WRITE);
+	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
+		return ECCX08_COMM_FAIL;
+
+	i2c_status = i2c_send_bytes(1, &word_address);
+
+	for (; (iov_count > 0) && (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS); iov_count--, iov++)
+	{
+		if (iov->length == 0)
+			continue;
+		// i2c_send_bytes() only reads from the buffer.
+		i2c_status = i2c_send_bytes(iov->length, (uint8_t *) iov->data);
+	}
+
+	(void) i2c_send_stop();
+	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
+		return ECCX08_COMM_FAIL;
+	else
+		return ECCX08_SUCCESS;
+}
+
+
 /** \brief This I2C function puts the ECCX08 device into idle state.
  * \return status of the operation
  */
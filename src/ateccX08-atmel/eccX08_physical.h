@@ -44,7 +44,21 @@ extern "C" {
 #define ECCX08_WAKEUP_DELAY			(uint8_t) (100.0 * CPU_CLOCK_DEVIATION_POSITIVE + 0.5)
 
 
+/** \brief This structure describes one contiguous block of a command packet.
+ *
+ * A command packet can be handed to the Physical layer as a list of blocks
+ * (count / op-code / parameters, data blocks, CRC) that are sent back to back
+ * without assembling them in a single buffer first.
+ */
+typedef struct
+{
+	const uint8_t *data;	//!< pointer to first byte of block
+	uint8_t length;			//!< number of bytes in block
+} eccX08_iovec_t;
+
+
 uint8_t	eccX08p_send_command(uint8_t count, uint8_t *command);
+uint8_t	eccX08p_send_command_iov(uint8_t iov_count, const eccX08_iovec_t *iov);
 uint8_t	eccX08p_receive_response(uint8_t size, uint8_t *response);
 void	eccX08p_init(void);
 void	eccX08p_i2c_set_spd(uint32_t spd_in_khz);
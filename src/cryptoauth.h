@@ -1,5 +1,8 @@
 #include "api/CryptoBuffer.h"
 #include "api/AtSha204.h"
 #include "api/AtEccX08.h"
+#include "api/EccSha256.h"
+#include "api/EccDrbg.h"
+#include "api/Sha256Hash.h"
 #include "softcrypto/sha256.h"
 #include "softcrypto/sha_256.h"